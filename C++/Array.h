@@ -1,36 +1,78 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <utility>
 #include <ostream>
+#include <memory>
+#include <new>
+#include <limits>
+#include <type_traits>
+#include <algorithm>
+
+
+
+/*
+Allocator returning memory aligned to at least Alignment bytes (e.g. 64 for the registers of AVX-512 or a cache line)
+*/
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+	typedef T value_type;
+	static constexpr size_t ALIGNMENT = Alignment > alignof(T) ? Alignment : alignof(T);
+	static_assert((Alignment & (Alignment - 1)) == 0, "The alignment has to be a power of two");
+
+	template<typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() = default;
+	template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n);
+	void deallocate(T* p, size_t n);
+
+	template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+
+//Tag to construct an Array without initializing its elements
+struct ArrayUninitialized {};
+inline constexpr ArrayUninitialized uninitialized{};
 
 
 
 /*
 This Array Class dynamically allocates its memory at runtime.
-After initialization, the size of the array cannot be modified
+Its size only changes by appending or repeating its content in place, which reuses the allocated capacity if possible.
+Arrays of trivially copyable types are copied with memcpy.
 */
-template<typename T>
+template<typename T, typename Allocator = AlignedAllocator<T>>
 class Array
 {
 public:
 	typedef T value_type;
+	typedef Allocator allocator_type;
 
 	Array();
-	Array(size_t s);
-	Array(const Array<T>& other);
+	Array(size_t s);						//The elements are value initialized (zero for arithmetic types)
+	Array(size_t s, ArrayUninitialized);	//The elements are default initialized (left uninitialized for trivial types)
+	Array(const Array& other);
 	Array(Array&& other);
 	~Array();
 
-	Array& operator=(const Array<T>& other);
-	Array& operator=(Array<T>&& other);
+	Array& operator=(const Array& other);
+	Array& operator=(Array&& other);
 	T& operator[](size_t i);
 	const T& operator[](size_t i) const;
-	Array<T>& operator+=(const Array<T>& other);
-	template<typename T2> friend Array<T2>& operator*=(size_t n, Array<T2>& arr);
-	Array<T> operator+(const Array<T>& other) const;
-	template<typename T2> friend Array<T2> operator*(size_t n, const Array<T2>& arr);
-	template<typename T2> friend std::ostream& operator<<(std::ostream& os, const Array<T2>& arr);
+	Array& operator+=(const Array& other);
+	template<typename T2, typename A2> friend Array<T2, A2>& operator*=(size_t n, Array<T2, A2>& arr);
+	Array operator+(const Array& other) const;
+	template<typename T2, typename A2> friend Array<T2, A2> operator*(size_t n, const Array<T2, A2>& arr);
+	template<typename T2, typename A2> friend std::ostream& operator<<(std::ostream& os, const Array<T2, A2>& arr);
+
+	Array& append(const Array& other);	//Append the elements of other (which may be this array itself)
+	Array& repeat(size_t n);			//Replace the content with n copies of it
+	void reserve(size_t c);				//Make sure the array can grow up to c elements without reallocating
 
 	T* begin();
 	const T* begin() const;
@@ -38,175 +80,408 @@ public:
 	const T* end() const;
 
 	size_t size() const;
+	size_t capacity() const;
 
 
 private:
+	typedef std::allocator_traits<Allocator> Traits;
+	static constexpr bool TRIVIAL = std::is_trivially_copyable<T>::value;
+
 	T* data = nullptr;
 	size_t array_size = 0;
-
+	size_t array_capacity = 0;
+	Allocator allocator;
+
+	T* allocate(size_t c);
+	void deallocate(T* p, size_t c);
+	void copy(T* dst, const T* src, size_t n);	//Construct copies of src in the uninitialized memory dst
+	void move(T* dst, T* src, size_t n);		//Same as copy, but the elements are moved if that cannot throw
+	void destroy(T* p, size_t n);
 	void swap(Array& other);
 };
 
 
-template<typename T>
-Array<T>::Array() : data(nullptr), array_size(0)
+
+//---------- AlignedAllocator Implementation ----------//
+
+template<typename T, size_t Alignment>
+T* AlignedAllocator<T, Alignment>::allocate(size_t n)
 {
+	if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+		throw std::bad_array_new_length();
+	return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
 }
 
 
-template<typename T>
-Array<T>::Array(size_t s) : data(new T[s]), array_size(s)
+template<typename T, size_t Alignment>
+void AlignedAllocator<T, Alignment>::deallocate(T* p, size_t)
 {
+	::operator delete(p, std::align_val_t(ALIGNMENT));
 }
 
 
-template<typename T>
-Array<T>::Array(const Array<T>& other) : data(new T[other.array_size]), array_size(other.array_size)
+
+//---------- Array Implementation ----------//
+
+template<typename T, typename Allocator>
+Array<T, Allocator>::Array() : data(nullptr), array_size(0), array_capacity(0)
 {
-	for (size_t i = 0; i < array_size; ++i)
-		data[i] = other[i];
 }
 
 
-template<typename T>
-Array<T>::Array(Array<T>&& other)
+template<typename T, typename Allocator>
+Array<T, Allocator>::Array(size_t s) : data(allocate(s)), array_size(0), array_capacity(s)
 {
-	swap(other);
+	if (std::is_trivially_default_constructible<T>::value && TRIVIAL) {
+		if (s)
+			std::memset(static_cast<void*>(data), 0, s * sizeof(T));
+		array_size = s;
+	}
+	else {
+		try {
+			for (; array_size < s; ++array_size)
+				Traits::construct(allocator, data + array_size);
+		}
+		catch (...) {
+			destroy(data, array_size);
+			deallocate(data, array_capacity);
+			throw;
+		}
+	}
 }
 
 
-template<typename T>
-Array<T>::~Array()
+template<typename T, typename Allocator>
+Array<T, Allocator>::Array(size_t s, ArrayUninitialized) : data(allocate(s)), array_size(0), array_capacity(s)
 {
-	if (data)
-		delete[] data;
+	if (std::is_trivially_default_constructible<T>::value)
+		array_size = s;
+	else {
+		try {
+			for (; array_size < s; ++array_size)
+				::new (static_cast<void*>(data + array_size)) T;
+		}
+		catch (...) {
+			destroy(data, array_size);
+			deallocate(data, array_capacity);
+			throw;
+		}
+	}
 }
 
 
-template<typename T>
-Array<T>& Array<T>::operator=(const Array<T>& other)
+template<typename T, typename Allocator>
+Array<T, Allocator>::Array(const Array& other)
+	: data(nullptr), array_size(0), array_capacity(0), allocator(Traits::select_on_container_copy_construction(other.allocator))
 {
-	if (data)
-		delete[] data;
+	data = allocate(other.array_size);
+	array_capacity = other.array_size;
+	try {
+		copy(data, other.data, other.array_size);
+	}
+	catch (...) {
+		deallocate(data, array_capacity);
+		throw;
+	}
 	array_size = other.array_size;
-	data = new T[array_size];
-	for (size_t i = 0; i < array_size; ++i)
-		data[i] = other[i];
+}
+
+
+template<typename T, typename Allocator>
+Array<T, Allocator>::Array(Array&& other)
+{
+	swap(other);
+}
+
+
+template<typename T, typename Allocator>
+Array<T, Allocator>::~Array()
+{
+	destroy(data, array_size);
+	deallocate(data, array_capacity);
+}
+
+
+template<typename T, typename Allocator>
+Array<T, Allocator>& Array<T, Allocator>::operator=(const Array& other)
+{
+	if (this == &other)
+		return *this;
+	if (other.array_size <= array_capacity && TRIVIAL) {
+		//Reuse the memory
+		if (other.array_size)
+			std::memcpy(static_cast<void*>(data), other.data, other.array_size * sizeof(T));
+		array_size = other.array_size;
+	}
+	else {
+		Array copied(other);
+		swap(copied);
+	}
 	return *this;
 }
 
 
-template<typename T>
-Array<T>& Array<T>::operator=(Array<T>&& other)
+template<typename T, typename Allocator>
+Array<T, Allocator>& Array<T, Allocator>::operator=(Array&& other)
 {
 	swap(other);
 	return *this;
 }
 
 
-template<typename T>
-T& Array<T>::operator[](size_t i)
+template<typename T, typename Allocator>
+T& Array<T, Allocator>::operator[](size_t i)
 {
 	return data[i];
 }
 
 
-template<typename T>
-const T& Array<T>::operator[](size_t i) const
+template<typename T, typename Allocator>
+const T& Array<T, Allocator>::operator[](size_t i) const
 {
 	return data[i];
 }
 
 
-template<typename T>
-Array<T>& Array<T>::operator+=(const Array<T>& other)
+template<typename T, typename Allocator>
+Array<T, Allocator>& Array<T, Allocator>::operator+=(const Array& other)
 {
-	swap(*this + other);
-	return *this;
+	return append(other);
 }
 
 
-template<typename T2>
-Array<T2>& operator*=(size_t n, Array<T2>& arr)
+template<typename T2, typename A2>
+Array<T2, A2>& operator*=(size_t n, Array<T2, A2>& arr)
 {
-	arr.swap(n * arr);
-	return arr;
+	return arr.repeat(n);
 }
 
 
-template<typename T>
-Array<T> Array<T>::operator+(const Array<T>& other) const
+template<typename T, typename Allocator>
+Array<T, Allocator> Array<T, Allocator>::operator+(const Array& other) const
 {
-	Array<T> result(array_size + other.array_size);
-	for (size_t i = 0; i < array_size; ++i)
-		result[i] = data[i];
-	for (size_t i = array_size; i < array_size + other.array_size; ++i)
-		result[i] = other[i];
+	Array result;
+	result.reserve(array_size + other.array_size);
+	result.append(*this);
+	result.append(other);
 	return result;
 }
 
 
-template<typename T2>
-Array<T2> operator*(size_t n, const Array<T2>& arr)
+template<typename T2, typename A2>
+Array<T2, A2> operator*(size_t n, const Array<T2, A2>& arr)
 {
-	Array<T2> result(n * arr.array_size);
-	for (size_t i = 0; i < n * arr.array_size; ++i)
-		result[i] = arr[i % arr.array_size];
+	Array<T2, A2> result;
+	result.reserve(n * arr.array_size);
+	result.append(arr);
+	result.repeat(n);
 	return result;
 }
 
 
-template<typename T2>
-std::ostream& operator<<(std::ostream& os, const Array<T2>& arr)
+template<typename T2, typename A2>
+std::ostream& operator<<(std::ostream& os, const Array<T2, A2>& arr)
 {
 	os << "[";
-	if (arr.array_size >= 1)
+	if (arr.array_size >= 1) {
 		os << arr[0];
-	for (auto it = arr.begin() + 1; it != arr.end(); ++it)
-		os << ", " << *it;
+		for (auto it = arr.begin() + 1; it != arr.end(); ++it)
+			os << ", " << *it;
+	}
 	os << "]";
 	return os;
 }
 
 
-template<typename T>
-T* Array<T>::begin()
+template<typename T, typename Allocator>
+Array<T, Allocator>& Array<T, Allocator>::append(const Array& other)
+{
+	const size_t n = other.array_size;
+	if (array_size + n <= array_capacity) {
+		//Source and destination never overlap, even if other is this array
+		copy(data + array_size, other.data, n);
+		array_size += n;
+		return *this;
+	}
+	//Copy the appended elements first, as other may be this array and its elements get moved below
+	const size_t c = std::max(array_size + n, 2 * array_capacity);
+	T* p = allocate(c);
+	try {
+		copy(p + array_size, other.data, n);
+	}
+	catch (...) {
+		deallocate(p, c);
+		throw;
+	}
+	try {
+		move(p, data, array_size);
+	}
+	catch (...) {
+		destroy(p + array_size, n);
+		deallocate(p, c);
+		throw;
+	}
+	destroy(data, array_size);
+	deallocate(data, array_capacity);
+	data = p;
+	array_size += n;
+	array_capacity = c;
+	return *this;
+}
+
+
+template<typename T, typename Allocator>
+Array<T, Allocator>& Array<T, Allocator>::repeat(size_t n)
+{
+	if (n == 0 || array_size == 0) {
+		destroy(data, array_size);
+		array_size = 0;
+		return *this;
+	}
+	const size_t s = array_size;
+	reserve(n * s);
+	//Double the copied block until the remainder fits
+	while (array_size < n * s) {
+		const size_t k = std::min(array_size, n * s - array_size);
+		copy(data + array_size, data, k);
+		array_size += k;
+	}
+	return *this;
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::reserve(size_t c)
+{
+	if (c <= array_capacity)
+		return;
+	T* p = allocate(c);
+	try {
+		move(p, data, array_size);
+	}
+	catch (...) {
+		deallocate(p, c);
+		throw;
+	}
+	destroy(data, array_size);
+	deallocate(data, array_capacity);
+	data = p;
+	array_capacity = c;
+}
+
+
+template<typename T, typename Allocator>
+T* Array<T, Allocator>::begin()
 {
 	return data;
 }
 
 
-template<typename T>
-const T* Array<T>::begin() const
+template<typename T, typename Allocator>
+const T* Array<T, Allocator>::begin() const
 {
 	return data;
 }
 
 
-template<typename T>
-T* Array<T>::end()
+template<typename T, typename Allocator>
+T* Array<T, Allocator>::end()
 {
 	return data + array_size;
 }
 
 
-template<typename T>
-const T* Array<T>::end() const
+template<typename T, typename Allocator>
+const T* Array<T, Allocator>::end() const
 {
 	return data + array_size;
 }
 
 
-template<typename T>
-size_t Array<T>::size() const
+template<typename T, typename Allocator>
+size_t Array<T, Allocator>::size() const
 {
 	return array_size;
 }
 
 
-template<typename T>
-void Array<T>::swap(Array<T>& other)
+template<typename T, typename Allocator>
+size_t Array<T, Allocator>::capacity() const
+{
+	return array_capacity;
+}
+
+
+template<typename T, typename Allocator>
+T* Array<T, Allocator>::allocate(size_t c)
+{
+	return c ? Traits::allocate(allocator, c) : nullptr;
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::deallocate(T* p, size_t c)
+{
+	if (p)
+		Traits::deallocate(allocator, p, c);
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::copy(T* dst, const T* src, size_t n)
+{
+	if (TRIVIAL) {
+		if (n)
+			std::memcpy(static_cast<void*>(dst), src, n * sizeof(T));
+		return;
+	}
+	size_t i = 0;
+	try {
+		for (; i < n; ++i)
+			Traits::construct(allocator, dst + i, src[i]);
+	}
+	catch (...) {
+		destroy(dst, i);
+		throw;
+	}
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::move(T* dst, T* src, size_t n)
+{
+	if (TRIVIAL) {
+		if (n)
+			std::memcpy(static_cast<void*>(dst), src, n * sizeof(T));
+		return;
+	}
+	size_t i = 0;
+	try {
+		for (; i < n; ++i)
+			Traits::construct(allocator, dst + i, std::move_if_noexcept(src[i]));
+	}
+	catch (...) {
+		destroy(dst, i);
+		throw;
+	}
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::destroy(T* p, size_t n)
+{
+	if (!std::is_trivially_destructible<T>::value) {
+		for (size_t i = 0; i < n; ++i)
+			Traits::destroy(allocator, p + i);
+	}
+}
+
+
+template<typename T, typename Allocator>
+void Array<T, Allocator>::swap(Array& other)
 {
 	std::swap(array_size, other.array_size);
+	std::swap(array_capacity, other.array_capacity);
 	std::swap(data, other.data);
-}
\ No newline at end of file
+	std::swap(allocator, other.allocator);
+}
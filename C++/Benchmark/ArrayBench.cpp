@@ -0,0 +1,57 @@
+#include "Benchmark.h"
+#include "../Array.h"
+
+
+
+namespace
+{
+	constexpr size_t SIZE = 16 << 20;
+}
+
+
+
+BENCHMARK(ArrayConstruct)
+{
+	state.bytes(SIZE);
+	state.measure([&]() { Benchmark::keep(Array<uint8_t>(SIZE)); });
+}
+
+
+BENCHMARK(ArrayConstructUninitialized)
+{
+	state.measure([&]() { Benchmark::keep(Array<uint8_t>(SIZE, uninitialized)); });
+}
+
+
+BENCHMARK(ArrayCopy)
+{
+	const Array<uint8_t> source(SIZE);
+	Array<uint8_t> destination;
+	state.bytes(SIZE);
+	state.measure([&]() {
+		destination = source;
+		Benchmark::keep(destination);
+	});
+}
+
+
+BENCHMARK(ArrayAppend)
+{
+	//Grows an array from many small pieces
+	const Array<uint8_t> piece(4096);
+	state.bytes(SIZE);
+	state.measure([&]() {
+		Array<uint8_t> array;
+		for (size_t i = 0; i < SIZE / 4096; ++i)
+			array += piece;
+		Benchmark::keep(array);
+	});
+}
+
+
+BENCHMARK(ArrayRepeat)
+{
+	const Array<uint8_t> block(4096);
+	state.bytes(SIZE);
+	state.measure([&]() { Benchmark::keep(SIZE / 4096 * block); });
+}
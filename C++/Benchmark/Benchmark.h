@@ -0,0 +1,389 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(BENCHMARK_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+
+/*
+  A small benchmark harness which only depends on the standard library.
+
+  BENCHMARK(name) { ... }
+      Defines and registers a benchmark. The body receives Benchmark::State& state, prepares its data
+	  and then calls state.measure(f), which calls f repeatedly and measures the time per call.
+
+  BENCHMARK_THREADS(name, 1, 2, 4, 8) { ... }
+      Same as BENCHMARK, but the body is run once for every thread count. It reads the current one with state.threads().
+
+  state.bytes(n) / state.items(n)
+      Number of bytes or items processed by one call of f, used to report the throughput or the time per item.
+
+  If BENCHMARK_COUNTERS is defined, the allocations (counted by the operator new defined in main.cpp) and
+  on Linux the cache misses (through perf events, if the kernel allows it) are reported per call of f as well.
+  The cache misses include the threads started during the measurement, but not threads which already existed.
+*/
+
+
+
+namespace Benchmark
+{
+
+	namespace detail
+	{
+#ifdef BENCHMARK_COUNTERS
+		inline std::atomic<size_t> allocations{0};
+		inline std::atomic<size_t> allocated_bytes{0};
+#endif
+
+
+#if defined(BENCHMARK_COUNTERS) && defined(__linux__)
+		//Counts the cache misses of the calling thread and of the threads it starts while the counter is running
+		class CacheMisses
+		{
+		public:
+			CacheMisses()
+			{
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.size = sizeof(attr);
+				attr.config = PERF_COUNT_HW_CACHE_MISSES;
+				attr.disabled = 1;
+				attr.inherit = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+			}
+			CacheMisses(const CacheMisses& other) = delete;
+			~CacheMisses() { if (fd >= 0) close(fd); }
+
+			bool available() const { return fd >= 0; }
+			void start() { if (fd >= 0) { ioctl(fd, PERF_EVENT_IOC_RESET, 0); ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); } }
+			uint64_t stop()
+			{
+				uint64_t count = 0;
+				if (fd >= 0) {
+					ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+					if (read(fd, &count, sizeof(count)) != sizeof(count))
+						count = 0;
+				}
+				return count;
+			}
+
+		private:
+			int fd;
+		};
+#endif
+	}
+
+
+	//Prevents the compiler from optimizing away the computation of value
+	template<typename T>
+	inline void keep(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r"(&value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+
+	class State
+	{
+	public:
+		explicit State(unsigned threads, double min_time) : thread_count(threads), min_time(min_time) {}
+
+		unsigned threads() const { return thread_count; }
+		void bytes(size_t n) { bytes_per_call = n; }
+		void items(size_t n) { items_per_call = n; }
+
+		//Calls f until at least min_time seconds passed and stores the median time per call
+		template<typename F>
+		void measure(F f);
+
+		//Writes a line with the results to os
+		void report(std::ostream& os, const std::string& name) const;
+
+
+	private:
+		using Clock = std::chrono::steady_clock;
+		static constexpr int MIN_BATCHES = 5;
+
+		unsigned thread_count;
+		double min_time;
+		size_t bytes_per_call = 0;
+		size_t items_per_call = 0;
+
+		bool measured = false;
+		double median = 0;	//Seconds per call
+		size_t calls = 0;
+		double allocations = -1;	//Per call, -1 if not counted
+		double cache_misses = -1;
+
+		static std::string duration(double seconds);
+	};
+
+
+	struct Registration
+	{
+		std::string name;
+		std::function<void(State&)> f;
+		std::vector<unsigned> threads;
+	};
+
+
+	inline std::vector<Registration>& registry()
+	{
+		static std::vector<Registration> benchmarks;
+		return benchmarks;
+	}
+
+
+	struct Registrar
+	{
+		Registrar(const char* name, void (*f)(State&), std::vector<unsigned> threads = {1})
+		{
+			registry().push_back({name, f, std::move(threads)});
+		}
+	};
+
+
+	//Runs all benchmarks whose name contains the filter given on the command line
+	//Usage: benchmark [filter] [--min-time=seconds]
+	int main(int argc, char** argv);
+
+
+
+	//---------- Data Sets ----------//
+
+	//Random bytes, which cannot be compressed
+	inline std::vector<uint8_t> random_bytes(size_t size, uint64_t seed = 1)
+	{
+		std::mt19937_64 rng(seed);
+		std::vector<uint8_t> data(size);
+		for (uint8_t& b : data)
+			b = (uint8_t)rng();
+		return data;
+	}
+
+
+	//English like text, the words are drawn from a Zipf distribution like in natural language
+	inline std::vector<uint8_t> text(size_t size, uint64_t seed = 1)
+	{
+		static const char* const WORDS[] = {
+			"the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he", "was", "for", "on", "are", "with",
+			"as", "his", "they", "be", "at", "one", "have", "this", "from", "or", "had", "by", "hot", "word", "but",
+			"what", "some", "we", "can", "out", "other", "were", "all", "there", "when", "up", "use", "your", "how",
+			"said", "an", "each", "she", "which", "do", "their", "time", "if", "will", "way", "about", "many", "then",
+			"them", "write", "would", "like", "so", "these", "her", "long", "make", "thing", "see", "him", "two",
+			"has", "look", "more", "day", "could", "go", "come", "did", "number", "sound", "no", "most", "people",
+			"my", "over", "know", "water", "than", "call", "first", "who", "may", "down", "side", "been", "now",
+			"find", "compression", "benchmark", "throughput", "latency", "memory", "allocation", "implementation"
+		};
+		const size_t count = sizeof(WORDS) / sizeof(WORDS[0]);
+		std::vector<double> weights(count);
+		for (size_t i = 0; i < count; ++i)
+			weights[i] = 1.0 / (i + 1);
+		std::mt19937_64 rng(seed);
+		std::discrete_distribution<size_t> word(weights.begin(), weights.end());
+		std::uniform_int_distribution<int> sentence(5, 20);
+		std::vector<uint8_t> data;
+		data.reserve(size + 32);
+		while (data.size() < size) {
+			const int length = sentence(rng);
+			for (int i = 0; i < length; ++i) {
+				const char* w = WORDS[word(rng)];
+				const size_t start = data.size();
+				data.insert(data.end(), w, w + std::strlen(w));
+				if (i == 0)
+					data[start] = (uint8_t)(data[start] - 'a' + 'A');
+				data.push_back(i + 1 < length ? ' ' : '.');
+			}
+			data.push_back(rng() % 8 ? ' ' : '\n');
+		}
+		data.resize(size);
+		return data;
+	}
+
+
+	//Scanlines of a synthetic screenshot: Runs of geometrically distributed length (mean run_length)
+	//of a few colors below 0x80, as needed by RLE
+	inline std::vector<uint8_t> runs(size_t size, double run_length = 32, uint64_t seed = 1)
+	{
+		std::mt19937_64 rng(seed);
+		std::geometric_distribution<size_t> length(1.0 / run_length);
+		std::uniform_int_distribution<int> color(0, 15);
+		std::vector<uint8_t> data;
+		data.reserve(size);
+		while (data.size() < size) {
+			const size_t n = std::min(length(rng) + 1, size - data.size());
+			data.insert(data.end(), n, (uint8_t)(color(rng) * 7));
+		}
+		return data;
+	}
+
+
+
+	//---------- State Implementation ----------//
+
+	template<typename F>
+	void State::measure(F f)
+	{
+		f();	//Warm up the caches and let lazily initialized data get created
+		//Find a number of calls per batch which takes long enough to be timed precisely
+		size_t batch = 1;
+		while (true) {
+			const auto start = Clock::now();
+			for (size_t i = 0; i < batch; ++i)
+				f();
+			const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			if (elapsed >= min_time / (4 * MIN_BATCHES) || batch >= (size_t(1) << 30))
+				break;
+			batch *= elapsed > 0 ? std::max<size_t>(2, std::min<size_t>(100, (size_t)(min_time / (4 * MIN_BATCHES) / elapsed) + 1)) : 100;
+		}
+
+#ifdef BENCHMARK_COUNTERS
+		size_t allocation_count = 0;	//Only counted within the batches, as recording the times allocates as well
+#ifdef __linux__
+		detail::CacheMisses misses;
+		misses.start();
+#endif
+#endif
+		std::vector<double> times;
+		double total = 0;
+		while (total < min_time || (int)times.size() < MIN_BATCHES) {
+#ifdef BENCHMARK_COUNTERS
+			const size_t allocations_before = detail::allocations.load(std::memory_order_relaxed);
+#endif
+			const auto start = Clock::now();
+			for (size_t i = 0; i < batch; ++i)
+				f();
+			const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+#ifdef BENCHMARK_COUNTERS
+			allocation_count += detail::allocations.load(std::memory_order_relaxed) - allocations_before;
+#endif
+			times.push_back(elapsed / batch);
+			total += elapsed;
+		}
+		calls = times.size() * batch;
+#ifdef BENCHMARK_COUNTERS
+#ifdef __linux__
+		const uint64_t miss_count = misses.stop();
+		if (misses.available())
+			cache_misses = (double)miss_count / calls;
+#endif
+		allocations = (double)allocation_count / calls;
+#endif
+
+		std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+		median = times[times.size() / 2];
+		measured = true;
+	}
+
+
+	inline void State::report(std::ostream& os, const std::string& name) const
+	{
+		os << std::left << std::setw(40) << name << std::right << std::setw(4) << thread_count;
+		if (!measured) {
+			os << "  measure() was not called\n";
+			return;
+		}
+		os << std::setw(12) << duration(median);
+		std::ostringstream rate;
+		rate << std::fixed << std::setprecision(1);
+		if (bytes_per_call)
+			rate << bytes_per_call / median / (1 << 20) << " MiB/s";
+		else if (items_per_call)
+			rate << duration(median / items_per_call) << "/item";
+		os << std::setw(18) << rate.str();
+		std::ostringstream counters;
+		counters << std::fixed << std::setprecision(1);
+		if (allocations >= 0)
+			counters << "  allocs " << allocations;
+		if (cache_misses >= 0)
+			counters << "  misses " << cache_misses;
+		os << counters.str() << "\n";
+	}
+
+
+	inline std::string State::duration(double seconds)
+	{
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(seconds < 1e-6 ? 1 : 2);
+		if (seconds < 1e-6)
+			ss << seconds * 1e9 << " ns";
+		else if (seconds < 1e-3)
+			ss << seconds * 1e6 << " us";
+		else if (seconds < 1)
+			ss << seconds * 1e3 << " ms";
+		else
+			ss << seconds << " s";
+		return ss.str();
+	}
+
+
+
+	//---------- Benchmark Runner ----------//
+
+	inline int main(int argc, char** argv)
+	{
+		std::string filter;
+		double min_time = 0.5;
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			if (arg.compare(0, 11, "--min-time=") == 0)
+				min_time = std::stod(arg.substr(11));
+			else
+				filter = arg;
+		}
+
+		std::vector<Registration> benchmarks = registry();
+		std::sort(benchmarks.begin(), benchmarks.end(), [](const Registration& a, const Registration& b) { return a.name < b.name; });
+		std::cout << std::left << std::setw(40) << "Benchmark" << std::right << std::setw(4) << "Thr"
+		          << std::setw(12) << "Time" << std::setw(18) << "Rate" << "\n";
+		for (const Registration& benchmark : benchmarks) {
+			if (benchmark.name.find(filter) == std::string::npos)
+				continue;
+			for (unsigned threads : benchmark.threads) {
+				State state(threads, min_time);
+				benchmark.f(state);
+				state.report(std::cout, benchmark.name);
+			}
+		}
+		return 0;
+	}
+
+}
+
+
+
+#define BENCHMARK_REGISTER(name, ...) \
+	static void name(Benchmark::State& state); \
+	static const Benchmark::Registrar name##_registrar(#name, name, __VA_ARGS__); \
+	static void name(Benchmark::State& state)
+
+//Defines a benchmark, which is run once
+#define BENCHMARK(name) BENCHMARK_REGISTER(name, {1})
+//Defines a benchmark, which is run once for every thread count in the list
+#define BENCHMARK_THREADS(name, ...) BENCHMARK_REGISTER(name, {__VA_ARGS__})
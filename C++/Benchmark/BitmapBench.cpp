@@ -0,0 +1,177 @@
+#include "Benchmark.h"
+#include "../Bitmap.h"
+
+#include <cstdio>
+#include <filesystem>
+
+
+
+namespace
+{
+	constexpr uint32_t WIDTH = 1920;
+	constexpr uint32_t HEIGHT = 1080;
+
+
+	std::string temp_path(const char* name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+
+	//Smooth gradients with some noise, like a photograph
+	const Bitmap& photo()
+	{
+		static const Bitmap image = []() {
+			Bitmap bmp(WIDTH, HEIGHT);
+			std::mt19937 rng(1);
+			std::uniform_real_distribution<float> noise(-0.02f, 0.02f);
+			for (uint32_t y = 0; y < HEIGHT; ++y) {
+				for (uint32_t x = 0; x < WIDTH; ++x) {
+					const float r = 0.5f + 0.4f * std::sin(x * 0.01f) + noise(rng);
+					const float g = (float)y / HEIGHT + noise(rng);
+					const float b = 0.5f + 0.4f * std::cos((x + y) * 0.005f) + noise(rng);
+					bmp(x, y) = Color(std::clamp(r, 0.f, 1.f), std::clamp(g, 0.f, 1.f), std::clamp(b, 0.f, 1.f));
+				}
+			}
+			return bmp;
+		}();
+		return image;
+	}
+
+
+	//A few flat colored shapes, like a diagram, which is saved with a colortable
+	const Bitmap& diagram()
+	{
+		static const Bitmap image = []() {
+			Bitmap bmp(WIDTH, HEIGHT, Color(1.f, 1.f, 1.f));
+			std::mt19937 rng(2);
+			std::uniform_real_distribution<float> coordinate(0.f, (float)WIDTH);
+			const Color colors[] = { Color(1.f, 0.f, 0.f), Color(0.f, 0.5f, 0.f), Color(0.f, 0.f, 1.f), Color(0.f, 0.f, 0.f) };
+			for (int i = 0; i < 50; ++i) {
+				std::vector<BitmapPoint> polygon;
+				for (int j = 0; j < 5; ++j)
+					polygon.push_back({coordinate(rng), coordinate(rng) * HEIGHT / WIDTH});
+				bmp.fillPolygon(polygon, colors[i % 4]);
+			}
+			return bmp;
+		}();
+		return image;
+	}
+
+
+	std::vector<BitmapSegment> segments(size_t count)
+	{
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> x(-100.f, WIDTH + 100.f), y(-100.f, HEIGHT + 100.f), c(0.f, 1.f);
+		std::vector<BitmapSegment> result(count);
+		for (BitmapSegment& segment : result) {
+			const float x1 = x(rng), y1 = y(rng);
+			segment = {{x1, y1}, {x1 + (x(rng) - WIDTH / 2) * 0.1f, y1 + (y(rng) - HEIGHT / 2) * 0.1f}, Color(c(rng), c(rng), c(rng))};
+		}
+		return result;
+	}
+}
+
+
+
+BENCHMARK(BitmapSave24bpp)
+{
+	const Bitmap& image = photo();
+	const std::string path = temp_path("benchmark_save.bmp");
+	state.bytes((size_t)WIDTH * HEIGHT * 3);
+	state.measure([&]() { image.save(path); });
+	std::remove(path.c_str());
+}
+
+
+BENCHMARK(BitmapSave32bpp)
+{
+	const Bitmap& image = photo();
+	const std::string path = temp_path("benchmark_save.bmp");
+	state.bytes((size_t)WIDTH * HEIGHT * 4);
+	state.measure([&]() { image.save(path, Bitmap::Quality::HIGH); });
+	std::remove(path.c_str());
+}
+
+
+BENCHMARK(BitmapSaveMapped24bpp)
+{
+	const Bitmap& image = photo();
+	const std::string path = temp_path("benchmark_save.bmp");
+	state.bytes((size_t)WIDTH * HEIGHT * 3);
+	state.measure([&]() { Benchmark::keep(image.saveMapped(path)); });
+	std::remove(path.c_str());
+}
+
+
+BENCHMARK(BitmapSaveColortable)
+{
+	const Bitmap& image = diagram();
+	const std::string path = temp_path("benchmark_save.bmp");
+	state.bytes((size_t)WIDTH * HEIGHT);
+	state.measure([&]() { image.save(path); });
+	std::remove(path.c_str());
+}
+
+
+BENCHMARK(BitmapLoad24bpp)
+{
+	const std::string path = temp_path("benchmark_load.bmp");
+	photo().save(path);
+	state.bytes((size_t)WIDTH * HEIGHT * 3);
+	state.measure([&]() { Benchmark::keep(Bitmap::load(path)); });
+	std::remove(path.c_str());
+}
+
+
+BENCHMARK(BitmapBlend)
+{
+	//Weighted sum of two images, evaluated in a single pass
+	const Bitmap& a = photo();
+	const Bitmap& b = diagram();
+	Bitmap result(WIDTH, HEIGHT);
+	state.bytes((size_t)WIDTH * HEIGHT * sizeof(Color));
+	state.measure([&]() {
+		result = a * 0.3f + b * 0.7f;
+		Benchmark::keep(result);
+	});
+}
+
+
+BENCHMARK(BitmapDrawLines)
+{
+	const std::vector<BitmapSegment> lines = segments(100000);
+	Bitmap image(WIDTH, HEIGHT);
+	state.items(lines.size());
+	state.measure([&]() {
+		image.drawLines(lines);
+		Benchmark::keep(image);
+	});
+}
+
+
+BENCHMARK(BitmapDrawLinesAntialiased)
+{
+	const std::vector<BitmapSegment> lines = segments(100000);
+	Bitmap image(WIDTH, HEIGHT);
+	state.items(lines.size());
+	state.measure([&]() {
+		image.drawLines(lines, true);
+		Benchmark::keep(image);
+	});
+}
+
+
+BENCHMARK(BitmapFillPolygon)
+{
+	std::vector<BitmapPoint> star;
+	for (int i = 0; i < 10; ++i) {
+		const float radius = i % 2 ? 200.f : 500.f;
+		star.push_back({WIDTH / 2 + radius * std::cos(i * 0.6283f), HEIGHT / 2 + radius * std::sin(i * 0.6283f)});
+	}
+	Bitmap image(WIDTH, HEIGHT);
+	state.measure([&]() {
+		image.fillPolygon(star, Color(0.2f, 0.4f, 0.6f));
+		Benchmark::keep(image);
+	});
+}
@@ -0,0 +1,168 @@
+#include "Benchmark.h"
+#include "../Compression.h"
+
+
+
+namespace
+{
+	constexpr size_t SIZE = 8 << 20;
+
+	const std::vector<uint8_t>& text()
+	{
+		static const std::vector<uint8_t> data = Benchmark::text(SIZE);
+		return data;
+	}
+
+
+	const std::vector<uint8_t>& scanlines()
+	{
+		static const std::vector<uint8_t> data = Benchmark::runs(SIZE);
+		return data;
+	}
+}
+
+
+
+//---------- Huffman ----------//
+
+BENCHMARK(HuffmanCompressText)
+{
+	const std::vector<uint8_t>& data = text();
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::compress(data.data(), data.size())); });
+}
+
+
+BENCHMARK(HuffmanCompressTextCanonical)
+{
+	const std::vector<uint8_t>& data = text();
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::compress(data.data(), data.size(), Huffman::Header::CANONICAL)); });
+}
+
+
+BENCHMARK(HuffmanCompressSmallMessages)
+{
+	//Many short messages, where the header is a large part of the output
+	const std::vector<uint8_t>& data = text();
+	constexpr size_t MESSAGE = 256;
+	constexpr size_t COUNT = 1024;
+	state.bytes(MESSAGE * COUNT);
+	state.measure([&]() {
+		for (size_t i = 0; i < COUNT; ++i)
+			Benchmark::keep(Huffman::compress(data.data() + i * MESSAGE, MESSAGE, Huffman::Header::CANONICAL));
+	});
+}
+
+
+BENCHMARK(HuffmanDecompressText)
+{
+	const std::vector<uint8_t>& data = text();
+	const std::vector<uint8_t> compressed = Huffman::compress(data.data(), data.size());
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::decompress<uint8_t>(compressed.data(), compressed.size())); });
+}
+
+
+BENCHMARK(HuffmanDecompressTextLimited)
+{
+	//Codewords of at most 11 bits are resolved with a single table lookup
+	const std::vector<uint8_t>& data = text();
+	const std::vector<uint8_t> compressed = Huffman::compress(data.data(), data.size(), Huffman::Header::CANONICAL, 11);
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::decompress<uint8_t>(compressed.data(), compressed.size(), Huffman::Header::CANONICAL)); });
+}
+
+
+BENCHMARK(HuffmanCompressRandom)
+{
+	const std::vector<uint8_t> data = Benchmark::random_bytes(SIZE);
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::compress(data.data(), data.size())); });
+}
+
+
+BENCHMARK_THREADS(HuffmanCompressBlocksText, 1, 2, 4, 8)
+{
+	const std::vector<uint8_t>& data = text();
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::compressBlocks(data.data(), data.size(), 262144, state.threads())); });
+}
+
+
+BENCHMARK_THREADS(HuffmanDecompressBlocksText, 1, 2, 4, 8)
+{
+	const std::vector<uint8_t>& data = text();
+	const std::vector<uint8_t> compressed = Huffman::compressBlocks(data.data(), data.size());
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Huffman::decompressBlocks<uint8_t>(compressed.data(), compressed.size(), state.threads())); });
+}
+
+
+
+//---------- RLE ----------//
+
+BENCHMARK(RLECompressScanlines)
+{
+	const std::vector<uint8_t>& data = scanlines();
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(RLE::compress(data.begin(), data.end())); });
+}
+
+
+BENCHMARK(RLECompressShortRuns)
+{
+	const std::vector<uint8_t> data = Benchmark::runs(SIZE, 2);
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(RLE::compress(data.begin(), data.end())); });
+}
+
+
+BENCHMARK(RLEEncoderChunks)
+{
+	//Streaming into a buffer which is reused for every chunk
+	const std::vector<uint8_t>& data = scanlines();
+	constexpr size_t CHUNK = 65536;
+	std::vector<uint8_t> buffer(2 * CHUNK + 2);
+	state.bytes(data.size());
+	state.measure([&]() {
+		RLE::Encoder<uint8_t> encoder;
+		for (size_t i = 0; i < data.size(); i += CHUNK) {
+			uint8_t* end = encoder.push(data.data() + i, data.data() + std::min(i + CHUNK, data.size()), buffer.data());
+			Benchmark::keep(end);
+		}
+		Benchmark::keep(encoder.finish(buffer.data()));
+	});
+}
+
+
+BENCHMARK(RLEDecompressScanlines)
+{
+	const std::vector<uint8_t>& data = scanlines();
+	const std::vector<uint8_t> compressed = RLE::compress(data.begin(), data.end());
+	std::vector<uint8_t> decompressed(RLE::decompressedSize(compressed.data(), compressed.data() + compressed.size()));
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(RLE::decompress(compressed.data(), compressed.data() + compressed.size(), decompressed.data())); });
+}
+
+
+
+//---------- Pipeline ----------//
+
+BENCHMARK(PipelineCompressScanlines)
+{
+	const std::vector<uint8_t>& data = scanlines();
+	state.bytes(data.size());
+	state.measure([&]() {
+		Benchmark::keep(Pipeline::compress(data.data(), data.size(), {Pipeline::Stage::RLE, Pipeline::Stage::HUFFMAN_CANONICAL}));
+	});
+}
+
+
+BENCHMARK(PipelineDecompressScanlines)
+{
+	const std::vector<uint8_t>& data = scanlines();
+	const std::vector<uint8_t> compressed = Pipeline::compress(data.data(), data.size(), {Pipeline::Stage::RLE, Pipeline::Stage::HUFFMAN_CANONICAL});
+	state.bytes(data.size());
+	state.measure([&]() { Benchmark::keep(Pipeline::decompress<uint8_t>(compressed.data(), compressed.size())); });
+}
@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+#include "../GF256.h"
+
+
+
+namespace
+{
+	constexpr size_t SHARD = 1 << 20;
+	constexpr unsigned DATA_SHARDS = 10;
+	constexpr unsigned PARITY_SHARDS = 4;
+
+
+	//Shards of a Reed-Solomon stripe, the data shards are filled with random bytes
+	struct Stripe
+	{
+		std::vector<std::vector<uint8_t>> buffers;
+		std::vector<uint8_t*> shards;
+
+		Stripe() : buffers(DATA_SHARDS + PARITY_SHARDS), shards(DATA_SHARDS + PARITY_SHARDS)
+		{
+			for (unsigned i = 0; i < DATA_SHARDS + PARITY_SHARDS; ++i) {
+				buffers[i] = i < DATA_SHARDS ? Benchmark::random_bytes(SHARD, i + 1) : std::vector<uint8_t>(SHARD);
+				shards[i] = buffers[i].data();
+			}
+		}
+	};
+}
+
+
+
+BENCHMARK(GF256MultiplyElements)
+{
+	const std::vector<uint8_t> a = Benchmark::random_bytes(SHARD, 1);
+	const std::vector<uint8_t> b = Benchmark::random_bytes(SHARD, 2);
+	std::vector<uint8_t> c(SHARD);
+	state.bytes(SHARD);
+	state.measure([&]() {
+		for (size_t i = 0; i < SHARD; ++i)
+			c[i] = (GF256(a[i]) * GF256(b[i])).as_int();
+		Benchmark::keep(c);
+	});
+}
+
+
+BENCHMARK(GF256MulRegion)
+{
+	const std::vector<uint8_t> src = Benchmark::random_bytes(SHARD);
+	std::vector<uint8_t> dst(SHARD);
+	state.bytes(SHARD);
+	state.measure([&]() {
+		gf256_mul_region(dst.data(), src.data(), 0x53, SHARD);
+		Benchmark::keep(dst);
+	});
+}
+
+
+BENCHMARK(GF256MulAddRegion)
+{
+	const std::vector<uint8_t> src = Benchmark::random_bytes(SHARD);
+	std::vector<uint8_t> dst(SHARD);
+	state.bytes(SHARD);
+	state.measure([&]() {
+		gf256_muladd_region(dst.data(), src.data(), 0x53, SHARD);
+		Benchmark::keep(dst);
+	});
+}
+
+
+BENCHMARK(GF256PolyEvaluate)
+{
+	const GF256Poly poly(Benchmark::random_bytes(32));
+	const std::vector<uint8_t> points = Benchmark::random_bytes(SHARD, 2);
+	std::vector<uint8_t> results(SHARD);
+	state.bytes(SHARD);
+	state.measure([&]() {
+		poly.evaluate(points.data(), results.data(), SHARD);
+		Benchmark::keep(results);
+	});
+}
+
+
+BENCHMARK(ReedSolomonEncode)
+{
+	const ReedSolomon rs(DATA_SHARDS, PARITY_SHARDS);
+	Stripe stripe;
+	state.bytes(DATA_SHARDS * SHARD);
+	state.measure([&]() {
+		rs.encode(stripe.shards.data(), stripe.shards.data() + DATA_SHARDS, SHARD);
+		Benchmark::keep(stripe.buffers);
+	});
+}
+
+
+BENCHMARK(ReedSolomonReconstruct)
+{
+	//Two data and two parity shards are lost
+	const ReedSolomon rs(DATA_SHARDS, PARITY_SHARDS);
+	Stripe stripe;
+	rs.encode(stripe.shards.data(), stripe.shards.data() + DATA_SHARDS, SHARD);
+	bool present[DATA_SHARDS + PARITY_SHARDS];
+	for (unsigned i = 0; i < DATA_SHARDS + PARITY_SHARDS; ++i)
+		present[i] = i != 1 && i != 7 && i != DATA_SHARDS && i != DATA_SHARDS + 2;
+	state.bytes(DATA_SHARDS * SHARD);
+	state.measure([&]() {
+		Benchmark::keep(rs.reconstruct(stripe.shards.data(), present, SHARD));
+	});
+}
+
+
+BENCHMARK_THREADS(StripeSchedulerApply, 1, 2, 4, 8)
+{
+	std::vector<uint8_t> x(PARITY_SHARDS), y(DATA_SHARDS);
+	for (unsigned i = 0; i < PARITY_SHARDS; ++i)
+		x[i] = (uint8_t)(DATA_SHARDS + i);
+	for (unsigned i = 0; i < DATA_SHARDS; ++i)
+		y[i] = (uint8_t)i;
+	const GF256Matrix matrix = GF256Matrix::cauchy(x, y);
+	Stripe stripe;
+	StripeScheduler scheduler(state.threads());
+	state.bytes(DATA_SHARDS * SHARD);
+	state.measure([&]() {
+		scheduler.apply(matrix, stripe.shards.data(), stripe.shards.data() + DATA_SHARDS, SHARD);
+		Benchmark::keep(stripe.buffers);
+	});
+}
@@ -0,0 +1,89 @@
+#include "Benchmark.h"
+#include "../Logging.h"
+
+#include <thread>
+
+
+
+namespace
+{
+	constexpr size_t MESSAGES = 20000;	//Per thread
+
+
+	//Discards everything, so only the logging itself is measured
+	class NullBuffer : public std::streambuf
+	{
+	protected:
+		int overflow(int c) override { return c; }
+		std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+	};
+
+
+	std::ostream& null_stream()
+	{
+		static NullBuffer buffer;
+		static std::ostream os(&buffer);
+		return os;
+	}
+
+
+	//Every thread writes MESSAGES messages
+	void write_messages(unsigned threads)
+	{
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < threads; ++t) {
+			workers.emplace_back([t]() {
+				for (size_t i = 0; i < MESSAGES; ++i)
+					LOG::write("worker " + std::to_string(t) + " finished job " + std::to_string(i), null_stream(), 'w');
+			});
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+}
+
+
+
+BENCHMARK_THREADS(LogWriteSync, 1, 2, 4, 8)
+{
+	LOG::activate('w');
+	state.items(state.threads() * MESSAGES);
+	state.measure([&]() { write_messages(state.threads()); });
+}
+
+
+BENCHMARK_THREADS(LogWriteAsync, 1, 2, 4, 8)
+{
+	//Includes waiting for the background thread to write the messages
+	LOG::activate('w');
+	LOG::start_async();
+	state.items(state.threads() * MESSAGES);
+	state.measure([&]() {
+		write_messages(state.threads());
+		LOG::flush();
+	});
+	LOG::stop_async();
+}
+
+
+BENCHMARK(LogWriteInactive)
+{
+	//The message is still built by the caller
+	LOG::deactivate('i');
+	state.items(MESSAGES);
+	state.measure([&]() {
+		for (size_t i = 0; i < MESSAGES; ++i)
+			LOG::write("inactive message " + std::to_string(i), null_stream(), 'i');
+	});
+}
+
+
+BENCHMARK(LogWriteMacroInactive)
+{
+	LOG::deactivate('i');
+	state.items(MESSAGES);
+	state.measure([&]() {
+		for (size_t i = 0; i < MESSAGES; ++i)
+			LOG_WRITE('i', null_stream(), "inactive message " + std::to_string(i));
+	});
+}
@@ -0,0 +1,186 @@
+#include "Benchmark.h"
+#include "../SkipList.h"
+
+#include <thread>
+
+
+
+namespace
+{
+	constexpr size_t COUNT = 200000;
+
+
+	//Distinct random keys in random order
+	const std::vector<uint64_t>& keys()
+	{
+		static const std::vector<uint64_t> data = []() {
+			std::mt19937_64 rng(1);
+			std::vector<uint64_t> k(COUNT);
+			for (size_t i = 0; i < COUNT; ++i)
+				k[i] = (rng() & ~uint64_t(0xFFFFF)) | i;
+			std::shuffle(k.begin(), k.end(), rng);
+			return k;
+		}();
+		return data;
+	}
+
+
+	const std::vector<uint64_t>& sorted_keys()
+	{
+		static const std::vector<uint64_t> data = []() {
+			std::vector<uint64_t> k = keys();
+			std::sort(k.begin(), k.end());
+			return k;
+		}();
+		return data;
+	}
+
+
+	//Calls f(first, last) on threads threads, each of them with an equal share of [0, count)
+	template<typename F>
+	void split(unsigned threads, size_t count, F f)
+	{
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < threads; ++t)
+			workers.emplace_back(f, count * t / threads, count * (t + 1) / threads);
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+}
+
+
+
+//---------- SkipList ----------//
+
+BENCHMARK(SkipListInsertRandom)
+{
+	const std::vector<uint64_t>& k = keys();
+	state.items(k.size());
+	state.measure([&]() {
+		SkipList<uint64_t> list;
+		for (uint64_t key : k)
+			list.insert(key);
+		Benchmark::keep(list);
+	});
+}
+
+
+BENCHMARK(SkipListInsertSorted)
+{
+	const std::vector<uint64_t>& k = sorted_keys();
+	state.items(k.size());
+	state.measure([&]() {
+		SkipList<uint64_t> list;
+		list.insert_sorted(k.begin(), k.end());
+		Benchmark::keep(list);
+	});
+}
+
+
+BENCHMARK(SkipListFromSorted)
+{
+	const std::vector<uint64_t>& k = sorted_keys();
+	state.items(k.size());
+	state.measure([&]() { Benchmark::keep(SkipList<uint64_t>::from_sorted(k.begin(), k.end())); });
+}
+
+
+BENCHMARK(SkipListFind)
+{
+	const std::vector<uint64_t>& k = keys();
+	const SkipList<uint64_t> list = SkipList<uint64_t>::from_sorted(sorted_keys().begin(), sorted_keys().end());
+	state.items(k.size());
+	state.measure([&]() {
+		for (uint64_t key : k)
+			Benchmark::keep(list.find(key));
+	});
+}
+
+
+BENCHMARK(SkipListRange)
+{
+	//Ranges of about 100 elements
+	const std::vector<uint64_t>& k = sorted_keys();
+	const SkipList<uint64_t> list = SkipList<uint64_t>::from_sorted(k.begin(), k.end());
+	constexpr size_t RANGES = 1000;
+	state.items(RANGES * 100);
+	state.measure([&]() {
+		for (size_t i = 0; i < RANGES; ++i) {
+			const size_t first = i * (k.size() - 100) / RANGES;
+			size_t n = 0;
+			for (uint64_t key : list.range(k[first], k[first + 100]))
+				n += key & 1;
+			Benchmark::keep(n);
+		}
+	});
+}
+
+
+BENCHMARK(SkipListEraseSorted)
+{
+	const std::vector<uint64_t>& k = sorted_keys();
+	state.items(k.size());
+	state.measure([&]() {
+		SkipList<uint64_t> list = SkipList<uint64_t>::from_sorted(k.begin(), k.end());
+		list.erase_sorted(k.begin(), k.end());
+		Benchmark::keep(list);
+	});
+}
+
+
+
+//---------- ConcurrentSkipList ----------//
+
+BENCHMARK_THREADS(ConcurrentSkipListInsert, 1, 2, 4, 8)
+{
+	const std::vector<uint64_t>& k = keys();
+	state.items(k.size());
+	state.measure([&]() {
+		ConcurrentSkipList<uint64_t> list;
+		split(state.threads(), k.size(), [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i)
+				list.insert(k[i]);
+		});
+		Benchmark::keep(list);
+	});
+}
+
+
+BENCHMARK_THREADS(ConcurrentSkipListContains, 1, 2, 4, 8)
+{
+	const std::vector<uint64_t>& k = keys();
+	ConcurrentSkipList<uint64_t> list;
+	for (uint64_t key : k)
+		list.insert(key);
+	state.items(k.size());
+	state.measure([&]() {
+		split(state.threads(), k.size(), [&](size_t first, size_t last) {
+			size_t found = 0;
+			for (size_t i = first; i < last; ++i)
+				found += list.contains(k[i]);
+			Benchmark::keep(found);
+		});
+	});
+}
+
+
+BENCHMARK_THREADS(ConcurrentSkipListMixed, 1, 2, 4, 8)
+{
+	//Every thread inserts and erases its share of the keys, while looking up the others
+	const std::vector<uint64_t>& k = keys();
+	ConcurrentSkipList<uint64_t> list;
+	for (size_t i = 0; i < k.size(); i += 2)
+		list.insert(k[i]);
+	state.items(2 * k.size());
+	state.measure([&]() {
+		split(state.threads(), k.size(), [&](size_t first, size_t last) {
+			size_t found = 0;
+			for (size_t i = first; i < last; ++i) {
+				if (i % 2)
+					list.erase(k[i]) || list.insert(k[i]);
+				found += list.contains(k[k.size() - 1 - i]);
+			}
+			Benchmark::keep(found);
+		});
+	});
+}
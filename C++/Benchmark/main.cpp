@@ -0,0 +1,88 @@
+/*
+  Benchmarks of the headers in the parent folder. Every header is benchmarked in its own translation unit.
+
+  Build (in this folder):
+      g++ -std=c++17 -O3 -march=native -pthread *.cpp -o benchmark
+      clang++ -std=c++17 -O3 -march=native -pthread *.cpp -o benchmark
+      cl /std:c++17 /O2 /EHsc *.cpp /Fe:benchmark.exe
+  Add -DBENCHMARK_COUNTERS (/DBENCHMARK_COUNTERS) to count allocations and cache misses.
+  On Linux the cache misses need perf events, e.g. sysctl kernel.perf_event_paranoid=2 or lower.
+  Further options of the headers can be set the same way, e.g. -DGF256_PRODUCT_TABLE.
+
+  Run:
+      ./benchmark [filter] [--min-time=seconds]
+  Only the benchmarks whose name contains filter are run, e.g. ./benchmark Huffman
+*/
+
+#include "Benchmark.h"
+
+#ifdef BENCHMARK_COUNTERS
+#include <cstdlib>
+#include <new>
+#endif
+
+
+
+#ifdef BENCHMARK_COUNTERS
+//Count every allocation, the array and nothrow versions call these as well
+
+void* operator new(size_t size)
+{
+	Benchmark::detail::allocations.fetch_add(1, std::memory_order_relaxed);
+	Benchmark::detail::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	Benchmark::detail::allocations.fetch_add(1, std::memory_order_relaxed);
+	Benchmark::detail::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	const size_t a = (size_t)alignment;
+#if defined(_WIN32)
+	if (void* p = _aligned_malloc(size ? size : 1, a))
+		return p;
+#else
+	if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a + (size ? 0 : a)))
+		return p;
+#endif
+	throw std::bad_alloc();
+}
+
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+#endif
+
+
+
+int main(int argc, char** argv)
+{
+	return Benchmark::main(argc, argv);
+}
@@ -11,6 +11,28 @@
 #include <cassert>
 #include <string>
 #include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 
@@ -52,6 +74,10 @@ public:
 	uint32_t intG(int bitcount) const;
 	uint8_t intB() const;
 	uint32_t intB(int bitcount) const;
+	//Return the color channels as floats in [0, 1]
+	float R() const;
+	float G() const;
+	float B() const;
 
 private:
 	float r, g, b;
@@ -68,47 +94,495 @@ namespace std
 		{
 			const int bpc = std::numeric_limits<size_t>::digits / 4;	//Bits per Color Channel
 			//Use integer representation of the color as a hash
-			return (col.intR(bpc) << (2 * bpc)) | (col.intG(bpc) << bpc) || col.intB(bpc);
+			return ((size_t)col.intR(bpc) << (2 * bpc)) | ((size_t)col.intG(bpc) << bpc) | (size_t)col.intB(bpc);
 		}
 	};
 }
 
 
 
-//Class for saving Windows Bitmap (BMP) Files
-//No support for reading bitmaps from file yet
-//Very basic line drawing support
-class Bitmap
+namespace bitmap_detail
 {
-public:
-	//Indicate the quality of the saved image
-	//Determines the colordepth
-	enum struct Quality { LOW, MEDIUM, HIGH };
+	//A file mapped into memory. data() is nullptr if the file could not be created or opened
+	class MappedFile
+	{
+	public:
+		//Create a file of size bytes for writing
+		MappedFile(const std::string& path, size_t size);
+		//Open an existing file for reading
+		explicit MappedFile(const std::string& path);
+		MappedFile(const MappedFile& other) = delete;
+		~MappedFile();
+
+		MappedFile& operator=(const MappedFile& other) = delete;
+
+		uint8_t* data() const;
+		size_t size() const;
+
+	private:
+		uint8_t* ptr;
+		size_t length;
+#if defined(_WIN32)
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int file;
+#endif
+	};
+}
+
+
+
+namespace bitmap_detail
+{
+	//Open addressing hash table mapping 0x00RRGGBB colors (or 10bit colors) to their index in a colortable
+	class ColorHashTable
+	{
+	public:
+		ColorHashTable();
+
+		//Returns the index of rgb. If rgb is not yet in the table, it gets inserted with index next
+		uint32_t insert(uint32_t rgb, uint32_t next);
+
+	private:
+		//Enough slots to keep the table at most a quarter full with 257 colors
+		static constexpr size_t SIZE = 1024;
+		static constexpr uint32_t EMPTY = 0xFFFFFFFF;
+		uint32_t keys[SIZE];
+		uint32_t values[SIZE];
+	};
+
+
+	//Reference to a pixel of a format, which does not store its pixels as Color
+	template<typename Format>
+	class PixelReference
+	{
+	public:
+		PixelReference(typename Format::Element* data, size_t index, size_t count);
+
+		PixelReference& operator=(const PixelReference& other);
+		PixelReference& operator=(const Color& color);
+		PixelReference& operator+=(const Color& other);
+		PixelReference& operator-=(const Color& other);
+		PixelReference& operator*=(const Color& other);
+		PixelReference& operator*=(float fac);
+		operator Color() const;
+
+	private:
+		typename Format::Element* data;
+		size_t index;
+		size_t count;
+	};
+}
+
+
+
+//Pixel storage formats of BasicBitmap. Color is only used for the arithmetic
+//A format stores a pixel in ELEMENTS elements of type Element. load and store convert the pixel with index
+//from and to a Color, where count is the number of pixels in the image
+//Formats with FLOAT_CHANNELS provide channels(), which returns all channels of the image as 3 * count floats
+namespace PixelFormat
+{
+	//One Color (3 floats) per pixel
+	struct RGBFloat
+	{
+		using Element = Color;
+		using Reference = Color&;
+		static constexpr size_t ELEMENTS = 1;
+		static constexpr bool FLOAT_CHANNELS = true;
+
+		static Color load(const Element* data, size_t index, size_t /*count*/)
+		{
+			return data[index];
+		}
+
+		static void store(Element* data, size_t index, size_t /*count*/, const Color& color)
+		{
+			data[index] = color;
+		}
+
+		static Reference reference(Element* data, size_t index, size_t /*count*/)
+		{
+			return data[index];
+		}
+
+		//The channels of the pixels as 3 * count consecutive floats
+		static float* channels(Element* data)
+		{
+			static_assert(sizeof(Color) == 3 * sizeof(float), "Color has to consist of its three channels only");
+			return reinterpret_cast<float*>(data);
+		}
+
+		static const float* channels(const Element* data)
+		{
+			return reinterpret_cast<const float*>(data);
+		}
+	};
+
+
+	//One packed 0xAARRGGBB integer (4 bytes) per pixel. Alpha is always stored as 0xFF
+	struct RGBA8
+	{
+		using Element = uint32_t;
+		using Reference = bitmap_detail::PixelReference<RGBA8>;
+		static constexpr size_t ELEMENTS = 1;
+		static constexpr bool FLOAT_CHANNELS = false;
+
+		static Color load(const Element* data, size_t index, size_t /*count*/)
+		{
+			return Color(data[index]);
+		}
+
+		static void store(Element* data, size_t index, size_t /*count*/, const Color& color)
+		{
+			data[index] = 0xFF000000
+						| ((uint32_t)(255 * color.R() + 0.5f) << 16)
+						| ((uint32_t)(255 * color.G() + 0.5f) <<  8)
+						| ((uint32_t)(255 * color.B() + 0.5f) <<  0);
+		}
+
+		static Reference reference(Element* data, size_t index, size_t count)
+		{
+			return Reference(data, index, count);
+		}
+	};
+
+
+	//Three separate float planes (red, green, blue) of count pixels each
+	struct PlanarFloat
+	{
+		using Element = float;
+		using Reference = bitmap_detail::PixelReference<PlanarFloat>;
+		static constexpr size_t ELEMENTS = 3;
+		static constexpr bool FLOAT_CHANNELS = true;
+
+		static Color load(const Element* data, size_t index, size_t count)
+		{
+			return Color(data[index], data[count + index], data[2 * count + index]);
+		}
+
+		static void store(Element* data, size_t index, size_t count, const Color& color)
+		{
+			data[index] = color.R();
+			data[count + index] = color.G();
+			data[2 * count + index] = color.B();
+		}
+
+		static Reference reference(Element* data, size_t index, size_t count)
+		{
+			return Reference(data, index, count);
+		}
+
+		static float* channels(Element* data)
+		{
+			return data;
+		}
+
+		static const float* channels(const Element* data)
+		{
+			return data;
+		}
+	};
+}
+
+
+
+//The colors of an image with at most 256 distinct colors and the colortable index of every pixel
+//colors holds 0x00RRGGBB values, indices one index per pixel. Both are empty if the image has more colors
+struct BitmapPalette
+{
+	std::vector<uint32_t> colors;
+	std::vector<uint8_t> indices;
+};
+
+
+//A point in pixel coordinates. Pixel (x, y) is centered at the integer coordinates x and y
+struct BitmapPoint
+{
+	float x;
+	float y;
+};
+
+
+//A line from p1 to p2 drawn by BasicBitmap::drawLines
+struct BitmapSegment
+{
+	BitmapPoint p1;
+	BitmapPoint p2;
+	Color color;
+};
+
+
+//Indicate the quality of the saved image
+//Determines the colordepth
+enum struct BitmapQuality { LOW, MEDIUM, HIGH };
+
+
+template<typename Format> class BasicBitmap;
+
+
+namespace bitmap_detail
+{
+	//Vectors of floats used to evaluate expressions on formats with FLOAT_CHANNELS
+	struct Scalar
+	{
+		using vector = float;
+		static constexpr size_t WIDTH = 1;
+
+		static vector load(const float* p) { return *p; }
+		static void store(float* p, vector v) { *p = v; }
+		static vector broadcast(float value) { return value; }
+		static vector add(vector a, vector b) { return a + b; }
+		static vector sub(vector a, vector b) { return a - b; }
+		static vector mul(vector a, vector b) { return a * b; }
+		static vector clamp(vector v) { return std::max(0.0f, std::min(1.0f, v)); }
+	};
+
+#if defined(__AVX__)
+#define BITMAP_SIMD
+	struct Simd
+	{
+		using vector = __m256;
+		static constexpr size_t WIDTH = 8;
+
+		static vector load(const float* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, vector v) { _mm256_storeu_ps(p, v); }
+		static vector broadcast(float value) { return _mm256_set1_ps(value); }
+		static vector add(vector a, vector b) { return _mm256_add_ps(a, b); }
+		static vector sub(vector a, vector b) { return _mm256_sub_ps(a, b); }
+		static vector mul(vector a, vector b) { return _mm256_mul_ps(a, b); }
+		static vector clamp(vector v) { return _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)); }
+	};
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BITMAP_SIMD
+	struct Simd
+	{
+		using vector = __m128;
+		static constexpr size_t WIDTH = 4;
+
+		static vector load(const float* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, vector v) { _mm_storeu_ps(p, v); }
+		static vector broadcast(float value) { return _mm_set1_ps(value); }
+		static vector add(vector a, vector b) { return _mm_add_ps(a, b); }
+		static vector sub(vector a, vector b) { return _mm_sub_ps(a, b); }
+		static vector mul(vector a, vector b) { return _mm_mul_ps(a, b); }
+		static vector clamp(vector v) { return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+	};
+#elif defined(__ARM_NEON)
+#define BITMAP_SIMD
+	struct Simd
+	{
+		using vector = float32x4_t;
+		static constexpr size_t WIDTH = 4;
+
+		static vector load(const float* p) { return vld1q_f32(p); }
+		static void store(float* p, vector v) { vst1q_f32(p, v); }
+		static vector broadcast(float value) { return vdupq_n_f32(value); }
+		static vector add(vector a, vector b) { return vaddq_f32(a, b); }
+		static vector sub(vector a, vector b) { return vsubq_f32(a, b); }
+		static vector mul(vector a, vector b) { return vmulq_f32(a, b); }
+		static vector clamp(vector v) { return vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f)); }
+	};
+#endif
+
+
+	//Minimum number of elements processed by one thread
+	constexpr size_t PARALLEL_GRAIN = 1 << 16;
+
+	//Split [0, count) into chunks of at least grain elements and call f(begin, end) for each of
+	//them on its own thread. Small ranges are processed on the calling thread
+	template<typename F>
+	void parallel_for(size_t count, const F& f, size_t grain = PARALLEL_GRAIN)
+	{
+		const size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count / grain);
+		if (threads <= 1) {
+			f((size_t)0, count);
+			return;
+		}
+		//Multiples of 64 elements keep the chunks aligned to the vector width
+		const size_t align = std::min<size_t>(grain, 64);
+		const size_t chunk = ((count + threads - 1) / threads + align - 1) / align * align;
+		std::vector<std::thread> workers;
+		for (size_t begin = chunk; begin < count; begin += chunk)
+			workers.emplace_back(f, begin, std::min(count, begin + chunk));
+		f((size_t)0, std::min(count, chunk));
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+
+	//Terms of an expression. eval<Vec>(i) evaluates the channels starting at index i of formats with
+	//FLOAT_CHANNELS, pixel(i) evaluates the pixel with index i of all other formats
+	template<typename Format>
+	struct ImageTerm
+	{
+		const BasicBitmap<Format>* image;
+
+		template<typename Vec>
+		typename Vec::vector eval(size_t i) const { return Vec::load(Format::channels(image->data()) + i); }
+		Color pixel(size_t i) const { return Format::load(image->data(), i, (size_t)image->Width() * image->Height()); }
+	};
+
+
+	struct ScalarTerm
+	{
+		float value;
+
+		template<typename Vec>
+		typename Vec::vector eval(size_t /*i*/) const { return Vec::broadcast(value); }
+		float pixel(size_t /*i*/) const { return value; }
+	};
+
+
+	//Operations of binary terms. Every intermediate result is clamped to [0, 1], as with Color
+	struct Add
+	{
+		template<typename Vec>
+		static typename Vec::vector eval(typename Vec::vector a, typename Vec::vector b) { return Vec::clamp(Vec::add(a, b)); }
+		static Color pixel(const Color& a, const Color& b) { return a + b; }
+	};
+
+
+	struct Sub
+	{
+		template<typename Vec>
+		static typename Vec::vector eval(typename Vec::vector a, typename Vec::vector b) { return Vec::clamp(Vec::sub(a, b)); }
+		static Color pixel(const Color& a, const Color& b) { return a - b; }
+	};
+
+
+	struct Mul
+	{
+		template<typename Vec>
+		static typename Vec::vector eval(typename Vec::vector a, typename Vec::vector b) { return Vec::clamp(Vec::mul(a, b)); }
+		static Color pixel(const Color& a, const Color& b) { return a * b; }
+		static Color pixel(Color a, float fac) { return a *= fac; }
+		static Color pixel(float fac, Color a) { return a *= fac; }
+	};
 
-	Bitmap(uint32_t width, uint32_t height);
-	Bitmap(uint32_t width, uint32_t height, Color fillcolor);
-	Bitmap(const Bitmap& other);
-	Bitmap(Bitmap&& other);
 
-	Bitmap& operator=(const Bitmap& other);
-	Bitmap& operator=(Bitmap&& other);
+	template<typename Op, typename L, typename R>
+	struct BinaryTerm
+	{
+		L l;
+		R r;
+
+		template<typename Vec>
+		typename Vec::vector eval(size_t i) const { return Op::template eval<Vec>(l.template eval<Vec>(i), r.template eval<Vec>(i)); }
+		Color pixel(size_t i) const { return Op::pixel(l.pixel(i), r.pixel(i)); }
+	};
+}
+
+
+//Unevaluated result of arithmetic on images of the same Format. It gets evaluated in a single pass without
+//temporary images once it is assigned to a BasicBitmap. Only holds pointers to the images it was built from
+template<typename Format, typename Term>
+struct BitmapExpression
+{
+	Term term;
+	uint32_t width;
+	uint32_t height;
+};
+
+
+namespace bitmap_detail
+{
+	//Maps the operands of the arithmetic operators to their terms
+	template<typename T>
+	struct Operand
+	{
+	};
+
+
+	template<typename F>
+	struct Operand<BasicBitmap<F>>
+	{
+		using Format = F;
+		using Term = ImageTerm<F>;
+		static Term term(const BasicBitmap<F>& image) { return Term{ &image }; }
+		static uint32_t width(const BasicBitmap<F>& image) { return image.Width(); }
+		static uint32_t height(const BasicBitmap<F>& image) { return image.Height(); }
+	};
+
+
+	template<typename F, typename T>
+	struct Operand<BitmapExpression<F, T>>
+	{
+		using Format = F;
+		using Term = T;
+		static Term term(const BitmapExpression<F, T>& expr) { return expr.term; }
+		static uint32_t width(const BitmapExpression<F, T>& expr) { return expr.width; }
+		static uint32_t height(const BitmapExpression<F, T>& expr) { return expr.height; }
+	};
+
+
+	//Result of a binary operator, only defined if both operands are images of the same format
+	template<typename Op, typename A, typename B>
+	using Binary = std::enable_if_t<std::is_same_v<typename Operand<A>::Format, typename Operand<B>::Format>,
+									BitmapExpression<typename Operand<A>::Format, BinaryTerm<Op, typename Operand<A>::Term, typename Operand<B>::Term>>>;
+
+	template<typename A>
+	using Scaled = BitmapExpression<typename Operand<A>::Format, BinaryTerm<Mul, typename Operand<A>::Term, ScalarTerm>>;
+
+	template<typename Op, typename A, typename B>
+	Binary<Op, A, B> combine(const A& a, const B& b)
+	{
+		assert(Operand<A>::width(a) == Operand<B>::width(b) && Operand<A>::height(a) == Operand<B>::height(b));
+		return { { Operand<A>::term(a), Operand<B>::term(b) }, Operand<A>::width(a), Operand<A>::height(a) };
+	}
+}
+
+
+
+//Class for saving and loading Windows Bitmap (BMP) Files
+//The pixels are stored in the given PixelFormat, Bitmap stores them as Color
+//Use BitmapFile to only decode the parts of a file which are accessed
+//Basic line and polygon drawing support
+template<typename Format>
+class BasicBitmap
+{
+public:
+	using Element = typename Format::Element;
+	using Reference = typename Format::Reference;
+
+	using Quality = BitmapQuality;
+
+	BasicBitmap(uint32_t width, uint32_t height);
+	BasicBitmap(uint32_t width, uint32_t height, Color fillcolor);
+	BasicBitmap(const BasicBitmap& other);
+	BasicBitmap(BasicBitmap&& other);
+	//Convert an image from another pixel format
+	template<typename OtherFormat>
+	explicit BasicBitmap(const BasicBitmap<OtherFormat>& other);
+	//Evaluate an arithmetic expression
+	template<typename Term>
+	BasicBitmap(const BitmapExpression<Format, Term>& expr);
+
+	BasicBitmap& operator=(const BasicBitmap& other);
+	BasicBitmap& operator=(BasicBitmap&& other);
+	template<typename Term>
+	BasicBitmap& operator=(const BitmapExpression<Format, Term>& expr);
 	//Access pixel color values
-	Color& operator()(uint32_t x, uint32_t y);
+	Reference operator()(uint32_t x, uint32_t y);
 	Color operator()(uint32_t x, uint32_t y) const;
 	//Linera interpolation between the pixels
 	Color operator()(float x, float y) const;
-	Bitmap& operator+=(const Bitmap& other);
-	Bitmap& operator-=(const Bitmap& other);
-	Bitmap& operator*=(const Bitmap& other);
-	Bitmap& operator*=(float fac);
-	friend Bitmap operator+(Bitmap b1, const Bitmap& b2);
-	friend Bitmap operator-(Bitmap b1, const Bitmap& b2);
-	friend Bitmap operator*(Bitmap b1, const Bitmap& b2);
-	friend Bitmap operator*(Bitmap b, float fac);
-	friend Bitmap operator*(float fac, Bitmap b);
-
-	//Draw a line with thickness 1 and no AA
+	//Channelwise arithmetic, other may be a BasicBitmap or a BitmapExpression of the same size
+	//The operators +, - and * on images return a BitmapExpression, such that e.g. dst = a*fa + b*fb
+	//gets evaluated in one pass. Large images are processed by multiple threads
+	template<typename Other> BasicBitmap& operator+=(const Other& other);
+	template<typename Other> BasicBitmap& operator-=(const Other& other);
+	template<typename Other> BasicBitmap& operator*=(const Other& other);
+	BasicBitmap& operator*=(float fac);
+
+	//Draw a line with thickness 1 and no AA. Parts outside of the image are clipped
 	void drawLine(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, const Color& color);
+	//Draw many lines with thickness 1 in the given order. Every segment gets clipped to the image once, and the
+	//image is rasterized in bands of rows in parallel. antialiased selects Wu's algorithm over Bresenham's
+	void drawLines(const std::vector<BitmapSegment>& segments, bool antialiased = false);
+	//Fill the polygon with the given corners using the even-odd rule. Pixels are filled if their center
+	//is inside the polygon
+	void fillPolygon(const std::vector<BitmapPoint>& points, const Color& color);
 
 	//Save the Image to a BMP File
 	//quality == LOW :    16bpp ( 5bits per channel)
@@ -117,43 +591,105 @@ public:
 	//The quality tag only gets used if the file contains more than 256 colors and
 	//thus cannot use a colortable
 	void save(const std::string& path, Quality quality = Quality::MEDIUM) const;
+	//Same as save, but the image data gets written directly into a memory mapped file
+	//Returns false if the file could not be created
+	bool saveMapped(const std::string& path, Quality quality = Quality::MEDIUM) const;
+	//Load a BMP file with 1, 4, 8, 16, 24 or 32 bits per pixel, as written by save
+	//Throws std::runtime_error if the file cannot be read or is not supported
+	static BasicBitmap load(const std::string& path);
 
 	//Get the dimensions of the image
 	uint32_t Width() const;
 	uint32_t Height() const;
+	//Get the raw pixel storage (Width() * Height() * Format::ELEMENTS elements)
+	const Element* data() const;
+	//Read or write the Width() pixels of row y at once
+	void getRow(uint32_t y, Color* row) const;
+	void setRow(uint32_t y, const Color* row);
+	//Collect the 8bit colors of the image in one pass. Empty if there are more than 256 colors or if
+	//the colortable would lose precision compared to saving with quality (the 10bit colors of Quality::HIGH)
+	BitmapPalette generatePalette(Quality quality = Quality::MEDIUM) const;
 
 
 private:
 	const int MAX_COLORTABLE_SIZE = 256;
+	static constexpr size_t PALETTE_CHUNK = 65536;	//Number of pixels generatePalette starts indexing with
 	uint32_t width;
 	uint32_t height;
-	std::vector<Color> image;
-
-	std::unordered_map<Color, uint8_t> generateColorTable() const;
-	void saveColorTable(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const;
-	void saveImageData1bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const;
-	void saveImageData4bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const;
-	void saveImageData8bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const;
-	void saveImageData16bpp(std::ostream& os) const;
-	void saveImageData24bpp(std::ostream& os) const;
-	void saveImageData32bpp(std::ostream& os) const;
-	template<typename T> std::ostream& write(std::ostream& os, T value, int length) const;
+	std::vector<Element> image;
+
+	//Layout of a BMP file as written by save
+	struct FileLayout
+	{
+		uint16_t biBitCount;
+		uint32_t biCompression;
+		uint32_t biClrUsed;
+		uint32_t bfOffBits;		//Size of the headers, bitmasks and colortable
+		uint32_t rowSize;		//Bytes per row including the padding
+		uint32_t bfSize;
+	};
+
+	//Read the pixel with index y*width + x
+	Color pixel(size_t index) const;
+	//Number of rows rasterized together by drawLines
+	static constexpr uint32_t BAND_HEIGHT = 64;
+
+	//Clip the segment to the image and order its points by y. Returns false if nothing is left
+	bool clip(BitmapSegment& segment) const;
+	//Draw the part of a clipped segment within the rows [row_begin, row_end)
+	void rasterizeLine(const BitmapSegment& segment, int32_t row_begin, int32_t row_end);
+	void rasterizeLineAA(const BitmapSegment& segment, int32_t row_begin, int32_t row_end);
+
+	//Evaluate term into this image. Each pixel of the result only depends on the same pixel of the
+	//operands, so this image may be one of them
+	template<typename Term> void assign(const Term& term);
+
+	FileLayout layout(Quality quality, const BitmapPalette& palette) const;
+	//Write everything in front of the image data (layout.bfOffBits bytes) to dst
+	void saveHeader(uint8_t* dst, const FileLayout& layout, const BitmapPalette& palette) const;
+	void saveColorTable(uint8_t* dst, const BitmapPalette& palette) const;
+	//Pack row y including the padding (layout.rowSize bytes) into dst
+	void saveRow(uint8_t* dst, uint32_t y, const FileLayout& layout, const BitmapPalette& palette) const;
+	void saveRow1bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const;
+	void saveRow4bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const;
+	void saveRow8bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const;
+	void saveRow16bpp(uint8_t* dst, uint32_t y) const;
+	void saveRow24bpp(uint8_t* dst, uint32_t y) const;
+	void saveRow32bpp(uint8_t* dst, uint32_t y) const;
+	//Write length bytes of value in little endian byte order to dst and return the end of the written bytes
+	template<typename T> static uint8_t* write(uint8_t* dst, T value, int length);
 
 	uint32_t ceil4(uint32_t n) const;
 
-	void swap(Bitmap& other);
+	void swap(BasicBitmap& other);
 };
 
 
+//Image with one Color per pixel
+using Bitmap = BasicBitmap<PixelFormat::RGBFloat>;
+
+
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Add, A, B> operator+(const A& a, const B& b);
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Sub, A, B> operator-(const A& a, const B& b);
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Mul, A, B> operator*(const A& a, const B& b);
+template<typename A>
+bitmap_detail::Scaled<A> operator*(const A& a, float fac);
+template<typename A>
+bitmap_detail::Scaled<A> operator*(float fac, const A& a);
+
+
 
 //---------- Color Implementation ----------//
 
-Color::Color() : r(0), g(0), b(0)
+inline Color::Color() : r(0), g(0), b(0)
 {
 }
 
 
-Color::Color(float r, float g, float b) : r(r), g(g), b(b)
+inline Color::Color(float r, float g, float b) : r(r), g(g), b(b)
 {
 	assert(r >= 0 && r <= 1);
 	assert(g >= 0 && g <= 1);
@@ -161,14 +697,14 @@ Color::Color(float r, float g, float b) : r(r), g(g), b(b)
 }
 
 
-Color::Color(uint32_t col) : r((float)((col & 0x00FF0000) >> 16) / 255),
+inline Color::Color(uint32_t col) : r((float)((col & 0x00FF0000) >> 16) / 255),
 							 g((float)((col & 0x0000FF00) >>  8) / 255),
 							 b((float)((col & 0x000000FF) >>  0) / 255)
 {
 }
 
 
-Color::Color(const Color& other) : r(other.r), g(other.g), b(other.b)
+inline Color::Color(const Color& other) : r(other.r), g(other.g), b(other.b)
 {
 }
 
@@ -280,6 +816,24 @@ inline uint32_t Color::intB(int bitcount) const
 }
 
 
+inline float Color::R() const
+{
+	return r;
+}
+
+
+inline float Color::G() const
+{
+	return g;
+}
+
+
+inline float Color::B() const
+{
+	return b;
+}
+
+
 inline bool Color::operator==(const Color& other) const
 {
 	return r == other.r && g == other.g && b == other.b;
@@ -306,35 +860,91 @@ inline Color mix(Color c1, const Color& c2, float fac)
 
 
 
+//A BMP file mapped into memory for reading. Pixels are only decoded when they are accessed, so
+//opening a file is cheap and only the touched rows are read from disk
+class BitmapFile
+{
+public:
+	//Throws std::runtime_error if the file cannot be read or is not supported
+	explicit BitmapFile(const std::string& path);
+
+	uint32_t Width() const;
+	uint32_t Height() const;
+	uint16_t BitCount() const;
+	//Decode a single pixel
+	Color operator()(uint32_t x, uint32_t y) const;
+	//Decode the Width() pixels of row y
+	void readRow(uint32_t y, Color* row) const;
+	//Decode the whole image
+	template<typename Format = PixelFormat::RGBFloat>
+	BasicBitmap<Format> read() const;
+
+private:
+	bitmap_detail::MappedFile file;
+	uint32_t width;
+	uint32_t height;
+	bool top_down;
+	uint16_t bit_count;
+	uint32_t row_size;
+	const uint8_t* pixels;
+	std::vector<Color> colortable;
+	//Bitmasks of red, green and blue for 16 and 32 bits per pixel
+	uint32_t masks[3];
+	int shifts[3];
+	float scales[3];
+
+	//Start of the stored row of image row y
+	const uint8_t* row(uint32_t y) const;
+	Color decode(const uint8_t* row, uint32_t x) const;
+	static uint32_t read(const uint8_t* src, int length);
+};
+
+
+
 //---------- Bitmap Implementation ----------//
 
-Bitmap::Bitmap(uint32_t width, uint32_t height) : width(width), height(height), image(width*height, Color())
+template<typename Format>
+BasicBitmap<Format>::BasicBitmap(uint32_t width, uint32_t height) : BasicBitmap(width, height, Color())
 {
-	assert(width  < 0x80000000);
-	assert(height < 0x80000000);
 }
 
 
-Bitmap::Bitmap(uint32_t width, uint32_t height, Color fillcolor) : width(width), height(height), image(width*height, fillcolor)
+template<typename Format>
+BasicBitmap<Format>::BasicBitmap(uint32_t width, uint32_t height, Color fillcolor) : width(width), height(height), image((size_t)width*height*Format::ELEMENTS)
 {
 	assert(width  < 0x80000000);
 	assert(height < 0x80000000);
+	for (size_t i = 0; i < (size_t)width*height; ++i)
+		Format::store(image.data(), i, (size_t)width*height, fillcolor);
 }
 
 
-Bitmap::Bitmap(const Bitmap& other)
+template<typename Format>
+BasicBitmap<Format>::BasicBitmap(const BasicBitmap& other)
 {
 	this->operator=(other);
 }
 
 
-Bitmap::Bitmap(Bitmap&& other) : width(0), height(0), image(0, Color())
+template<typename Format>
+BasicBitmap<Format>::BasicBitmap(BasicBitmap&& other) : width(0), height(0), image()
 {
 	swap(other);
 }
 
 
-Bitmap& Bitmap::operator=(const Bitmap& other)
+template<typename Format>
+template<typename OtherFormat>
+BasicBitmap<Format>::BasicBitmap(const BasicBitmap<OtherFormat>& other) : width(other.Width()), height(other.Height()), image((size_t)width*height*Format::ELEMENTS)
+{
+	for (uint32_t y = 0; y < height; ++y)
+		for (uint32_t x = 0; x < width; ++x)
+			Format::store(image.data(), (size_t)y*width + x, (size_t)width*height, other(x, y));
+}
+
+
+template<typename Format>
+BasicBitmap<Format>& BasicBitmap<Format>::operator=(const BasicBitmap& other)
 {
 	width = other.width;
 	height = other.height;
@@ -343,28 +953,32 @@ Bitmap& Bitmap::operator=(const Bitmap& other)
 }
 
 
-Bitmap& Bitmap::operator=(Bitmap&& other)
+template<typename Format>
+BasicBitmap<Format>& BasicBitmap<Format>::operator=(BasicBitmap&& other)
 {
 	swap(other);
 	return *this;
 }
 
 
-inline Color& Bitmap::operator()(uint32_t x, uint32_t y)
+template<typename Format>
+typename BasicBitmap<Format>::Reference BasicBitmap<Format>::operator()(uint32_t x, uint32_t y)
 {
 	assert(x < width && y < height);
-	return image[y*width + x];
+	return Format::reference(image.data(), (size_t)y*width + x, (size_t)width*height);
 }
 
 
-inline Color Bitmap::operator()(uint32_t x, uint32_t y) const
+template<typename Format>
+Color BasicBitmap<Format>::operator()(uint32_t x, uint32_t y) const
 {
 	assert(x < width && y < height);
-	return image[y*width + x];
+	return pixel((size_t)y*width + x);
 }
 
 
-inline Color Bitmap::operator()(float x, float y) const
+template<typename Format>
+Color BasicBitmap<Format>::operator()(float x, float y) const
 {
 	Color c00 = this->operator()((uint32_t)std::floor(x), (uint32_t)std::floor(y));
 	Color c01 = this->operator()((uint32_t)std::floor(x), (uint32_t)std::ceil(y));
@@ -376,417 +990,1090 @@ inline Color Bitmap::operator()(float x, float y) const
 }
 
 
-inline Bitmap& Bitmap::operator+=(const Bitmap& other)
+template<typename Format>
+template<typename Term>
+BasicBitmap<Format>::BasicBitmap(const BitmapExpression<Format, Term>& expr) : width(expr.width), height(expr.height), image((size_t)width*height*Format::ELEMENTS)
 {
-	assert(width == other.width && height == other.height);
-	for (size_t i = 0; i < image.size(); ++i)
-		image[i] += other.image[i];
-	return *this;
+	assign(expr.term);
 }
 
 
-inline Bitmap& Bitmap::operator-=(const Bitmap& other)
+template<typename Format>
+template<typename Term>
+BasicBitmap<Format>& BasicBitmap<Format>::operator=(const BitmapExpression<Format, Term>& expr)
 {
-	assert(width == other.width && height == other.height);
-	for (size_t i = 0; i < image.size(); ++i)
-		image[i] -= other.image[i];
+	if (width != expr.width || height != expr.height) {
+		//The expression cannot refer to this image, as it has a different size
+		width = expr.width;
+		height = expr.height;
+		image.assign((size_t)width*height*Format::ELEMENTS, Element());
+	}
+	assign(expr.term);
 	return *this;
 }
 
 
-inline Bitmap& Bitmap::operator*=(const Bitmap& other)
+template<typename Format>
+template<typename Other>
+BasicBitmap<Format>& BasicBitmap<Format>::operator+=(const Other& other)
 {
-	assert(width == other.width && height == other.height);
-	for (size_t i = 0; i < image.size(); ++i)
-		image[i] *= other.image[i];
-	return *this;
+	return *this = *this + other;
 }
 
 
-inline Bitmap& Bitmap::operator*=(float fac)
+template<typename Format>
+template<typename Other>
+BasicBitmap<Format>& BasicBitmap<Format>::operator-=(const Other& other)
 {
-	for (size_t i = 0; i < image.size(); ++i)
-		image[i] *= fac;
-	return *this;
+	return *this = *this - other;
 }
 
 
-inline Bitmap operator+(Bitmap b1, const Bitmap& b2)
+template<typename Format>
+template<typename Other>
+BasicBitmap<Format>& BasicBitmap<Format>::operator*=(const Other& other)
 {
-	b1 += b2;
-	return b1;
+	return *this = *this * other;
 }
 
 
-inline Bitmap operator-(Bitmap b1, const Bitmap& b2)
+template<typename Format>
+BasicBitmap<Format>& BasicBitmap<Format>::operator*=(float fac)
 {
-	b1 -= b2;
-	return b1;
+	return *this = *this * fac;
 }
 
 
-inline Bitmap operator*(Bitmap b1, const Bitmap& b2)
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Add, A, B> operator+(const A& a, const B& b)
 {
-	b1 *= b2;
-	return b1;
+	return bitmap_detail::combine<bitmap_detail::Add>(a, b);
 }
 
 
-inline Bitmap operator*(Bitmap b, float fac)
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Sub, A, B> operator-(const A& a, const B& b)
 {
-	b *= fac;
-	return b;
+	return bitmap_detail::combine<bitmap_detail::Sub>(a, b);
 }
 
 
-inline Bitmap operator*(float fac, Bitmap b)
+template<typename A, typename B>
+bitmap_detail::Binary<bitmap_detail::Mul, A, B> operator*(const A& a, const B& b)
 {
-	b *= fac;
-	return b;
+	return bitmap_detail::combine<bitmap_detail::Mul>(a, b);
 }
 
 
-void Bitmap::drawLine(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, const Color& color)
+template<typename A>
+bitmap_detail::Scaled<A> operator*(const A& a, float fac)
 {
-	int32_t dx = x2 - x1;
-	int32_t dy = y2 - y1;
-	if (dx >= 0 && ((dy >= 0 && dy <= dx) || (dy <= 0 && -dy <= dx))) {		//First and eighth octant
-		float m = ((float)dy) / dx;
-		float err = 0.5;
-		uint32_t y = y1;
-		for (uint32_t x = x1; x <= x2; ++x) {
-			err += m;
-			if (err >= 1) {
-				y += 1;
-				err -= 1;
-			}
-			if (err <= -1) {
-				y -= 1;
-				err += 1;
-			}
-			this->operator()(x, y) = color;
+	using Operand = bitmap_detail::Operand<A>;
+	return { { Operand::term(a), { fac } }, Operand::width(a), Operand::height(a) };
+}
+
+
+template<typename A>
+bitmap_detail::Scaled<A> operator*(float fac, const A& a)
+{
+	return a * fac;
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::drawLine(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, const Color& color)
+{
+	BitmapSegment segment{ { (float)x1, (float)y1 }, { (float)x2, (float)y2 }, color };
+	if (clip(segment))
+		rasterizeLine(segment, 0, height);
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::drawLines(const std::vector<BitmapSegment>& segments, bool antialiased)
+{
+	std::vector<BitmapSegment> clipped;
+	clipped.reserve(segments.size());
+	size_t work = 0;
+	for (BitmapSegment segment : segments) {
+		if (!clip(segment))
+			continue;
+		work += (size_t)(std::abs(segment.p2.x - segment.p1.x) + std::abs(segment.p2.y - segment.p1.y)) + 1;
+		clipped.push_back(segment);
+	}
+	auto rasterize = [&](const BitmapSegment& segment, int32_t row_begin, int32_t row_end) {
+		if (antialiased)
+			rasterizeLineAA(segment, row_begin, row_end);
+		else
+			rasterizeLine(segment, row_begin, row_end);
+	};
+
+	//Only use multiple threads if enough pixels are drawn
+	if (std::thread::hardware_concurrency() <= 1 || work < bitmap_detail::PARALLEL_GRAIN) {
+		for (const BitmapSegment& segment : clipped)
+			rasterize(segment, 0, height);
+		return;
+	}
+
+	//Sort the segments into the bands they touch with a counting sort, keeping their order
+	const uint32_t bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	std::vector<std::pair<uint32_t, uint32_t>> touched(clipped.size());	//First and last band of each segment
+	std::vector<size_t> offsets(bands + 1, 0);
+	for (size_t index = 0; index < clipped.size(); ++index) {
+		//Rounding the end points moves the lines by up to half a pixel and antialiased lines
+		//also touch the row below
+		touched[index].first = (uint32_t)std::max(0.0f, clipped[index].p1.y - 0.5f) / BAND_HEIGHT;
+		touched[index].second = std::min(height - 1, (uint32_t)(clipped[index].p2.y + 0.5f) + 1) / BAND_HEIGHT;
+		for (uint32_t band = touched[index].first; band <= touched[index].second; ++band)
+			++offsets[band + 1];
+	}
+	for (uint32_t band = 0; band < bands; ++band)
+		offsets[band + 1] += offsets[band];
+	std::vector<uint32_t> binned(offsets[bands]);
+	std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (uint32_t index = 0; index < clipped.size(); ++index)
+		for (uint32_t band = touched[index].first; band <= touched[index].second; ++band)
+			binned[fill[band]++] = index;
+
+	bitmap_detail::parallel_for(bands, [&](size_t begin, size_t end) {
+		for (size_t band = begin; band < end; ++band) {
+			const int32_t row_begin = band * BAND_HEIGHT;
+			const int32_t row_end = std::min(height, (uint32_t)(band + 1) * BAND_HEIGHT);
+			for (size_t i = offsets[band]; i < offsets[band + 1]; ++i)
+				rasterize(clipped[binned[i]], row_begin, row_end);
 		}
+	}, 1);
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::fillPolygon(const std::vector<BitmapPoint>& points, const Color& color)
+{
+	if (points.size() < 3 || width == 0 || height == 0)
+		return;
+	float min_y = points[0].y;
+	float max_y = points[0].y;
+	for (const BitmapPoint& point : points) {
+		min_y = std::min(min_y, point.y);
+		max_y = std::max(max_y, point.y);
 	}
-	else if (dx <= 0 && ((dy >= 0 && dy <= -dx) || (dy <= 0 && -dy <= -dx))) {		//Fourth and fifth octant
-		float m = ((float)dy) / dx;
-		float err = 0.5;
-		uint32_t y = y2;
-		for (uint32_t x = x2; x <= x1; ++x) {
-			err += m;
-			if (err >= 1) {
-				y += 1;
-				err -= 1;
+	const int32_t first = (int32_t)std::max(0.0f, std::ceil(min_y));
+	const int32_t last = (int32_t)std::min((float)height - 1, std::floor(max_y));
+	if (first > last)
+		return;
+
+	const size_t count = (size_t)width*height;
+	const size_t grain = std::max<size_t>(1, bitmap_detail::PARALLEL_GRAIN / std::max<size_t>(width, points.size()));
+	bitmap_detail::parallel_for(last - first + 1, [&](size_t begin, size_t end) {
+		std::vector<float> crossings;
+		for (int32_t y = first + (int32_t)begin; y < first + (int32_t)end; ++y) {
+			//Intersect the scanline with every edge, counting the lower end of an edge but not the upper one
+			crossings.clear();
+			for (size_t i = 0; i < points.size(); ++i) {
+				const BitmapPoint& a = points[i];
+				const BitmapPoint& b = points[(i + 1) % points.size()];
+				if ((a.y <= y && y < b.y) || (b.y <= y && y < a.y))
+					crossings.push_back(a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y));
 			}
-			if (err <= -1) {
-				y -= 1;
-				err += 1;
+			std::sort(crossings.begin(), crossings.end());
+			//Fill the pixels with x in [crossings[i], crossings[i + 1])
+			for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+				const int32_t x_begin = (int32_t)std::max(0.0f, std::ceil(crossings[i]));
+				const int32_t x_end = (int32_t)std::min((float)width, std::ceil(crossings[i + 1]));
+				for (int32_t x = x_begin; x < x_end; ++x)
+					Format::store(image.data(), (size_t)y*width + x, count, color);
 			}
-			this->operator()(x, y) = color;
 		}
+	}, grain);
+}
+
+
+template<typename Format>
+bool BasicBitmap<Format>::clip(BitmapSegment& segment) const
+{
+	if (width == 0 || height == 0)
+		return false;
+	auto inside = [&](const BitmapPoint& point) { return point.x >= 0 && point.y >= 0 && point.x <= width - 1 && point.y <= height - 1; };
+	if (inside(segment.p1) && inside(segment.p2)) {
+		if (segment.p1.y > segment.p2.y)
+			std::swap(segment.p1, segment.p2);
+		return true;
 	}
-	else if (dy <= 0 && ((dx >= 0 && dx <= -dy) || (dx <= 0 && -dx <= -dy))) {		//Sixth and seventh octant
-		float m = ((float)dx) / dy;
-		float err = 0.5;
-		uint32_t x = x2;
-		for (uint32_t y = y2; y <= y1; ++y) {
-			err += m;
-			if (err >= 1) {
-				x += 1;
-				err -= 1;
-			}
-			if (err <= -1) {
-				x -= 1;
-				err += 1;
-			}
-			this->operator()(x, y) = color;
+	//Liang-Barsky clipping against [0, width - 1] x [0, height - 1]
+	const float dx = segment.p2.x - segment.p1.x;
+	const float dy = segment.p2.y - segment.p1.y;
+	const float p[4] = { -dx, dx, -dy, dy };
+	const float q[4] = { segment.p1.x, width - 1 - segment.p1.x, segment.p1.y, height - 1 - segment.p1.y };
+	float t0 = 0;
+	float t1 = 1;
+	for (int i = 0; i < 4; ++i) {
+		if (p[i] == 0) {
+			if (q[i] < 0)	//Parallel to and outside of this edge
+				return false;
+		}
+		else {
+			const float t = q[i] / p[i];
+			if (p[i] < 0)
+				t0 = std::max(t0, t);
+			else
+				t1 = std::min(t1, t);
 		}
 	}
-	else if (dy >= 0 && ((dx >= 0 && dx <= dy) || (dx <= 0 && -dx <= dy))) {		//Second and third octant
-		float m = ((float)dx) / dy;
-		float err = 0.5;
-		uint32_t x = x1;
-		for (uint32_t y = y1; y <= y2; ++y) {
-			err += m;
-			if (err >= 1) {
-				x += 1;
-				err -= 1;
-			}
-			if (err <= -1) {
-				x -= 1;
-				err += 1;
+	if (t0 > t1)
+		return false;
+	const BitmapPoint p1 = segment.p1;
+	if (t1 < 1)
+		segment.p2 = { p1.x + t1 * dx, p1.y + t1 * dy };
+	if (t0 > 0)
+		segment.p1 = { p1.x + t0 * dx, p1.y + t0 * dy };
+	//Guard against rounding errors of the intersections
+	for (BitmapPoint* point : { &segment.p1, &segment.p2 }) {
+		point->x = std::max(0.0f, std::min((float)width - 1, point->x));
+		point->y = std::max(0.0f, std::min((float)height - 1, point->y));
+	}
+	if (segment.p1.y > segment.p2.y)
+		std::swap(segment.p1, segment.p2);
+	return true;
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::rasterizeLine(const BitmapSegment& segment, int32_t row_begin, int32_t row_end)
+{
+	//Clipped coordinates are not negative, so truncation rounds them
+	const int32_t x1 = (int32_t)(segment.p1.x + 0.5f);
+	const int32_t y1 = (int32_t)(segment.p1.y + 0.5f);
+	const int32_t x2 = (int32_t)(segment.p2.x + 0.5f);
+	const int32_t y2 = (int32_t)(segment.p2.y + 0.5f);
+	const int32_t sx = x2 >= x1 ? 1 : -1;
+	const bool x_major = std::abs(x2 - x1) >= y2 - y1;
+	//Step k along the major axis moves the minor axis by floor((2*k*a + b) / (2*b)) pixels
+	const int64_t a = x_major ? y2 - y1 : std::abs(x2 - x1);
+	const int64_t b = std::max<int64_t>(1, x_major ? std::abs(x2 - x1) : y2 - y1);
+	const int64_t n = x_major ? std::abs(x2 - x1) : y2 - y1;
+	auto row = [&](int64_t k) { return x_major ? y1 + (2*k*a + b) / (2*b) : y1 + k; };
+
+	//The rows are ascending in k, so find the steps within the band by binary search
+	auto first_step = [&](int32_t r) {
+		if (r <= y1)
+			return (int64_t)0;
+		if (r > y2)
+			return n + 1;
+		int64_t low = 0, high = n + 1;
+		while (low < high) {
+			const int64_t mid = (low + high) / 2;
+			if (row(mid) < r)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		return low;
+	};
+	const int64_t k_begin = first_step(row_begin);
+	const int64_t k_end = first_step(row_end);
+
+	//Walk through the image with the offsets of a major and a minor step
+	const size_t count = (size_t)width*height;
+	const int64_t major_step = x_major ? sx : (int64_t)width;
+	const int64_t minor_step = x_major ? (int64_t)width : sx;
+	int64_t minor = k_begin ? (2*k_begin*a + b) / (2*b) : 0;
+	int64_t error = k_begin ? (2*k_begin*a + b) % (2*b) : b;
+	int64_t index = (int64_t)y1*width + x1 + k_begin*major_step + minor*minor_step;
+	for (int64_t k = k_begin; k < k_end; ++k) {
+		Format::store(image.data(), index, count, segment.color);
+		index += major_step;
+		error += 2*a;
+		if (error >= 2*b) {
+			error -= 2*b;
+			index += minor_step;
+		}
+	}
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::rasterizeLineAA(const BitmapSegment& segment, int32_t row_begin, int32_t row_end)
+{
+	const BitmapPoint p1 = segment.p1;
+	const BitmapPoint p2 = segment.p2;
+	const bool x_major = std::abs(p2.x - p1.x) >= p2.y - p1.y;
+	const size_t count = (size_t)width*height;
+	auto blend = [&](int64_t x, int64_t y, float coverage) {
+		if (x < 0 || x >= width || y < row_begin || y >= row_end)
+			return;
+		const size_t index = (size_t)y*width + x;
+		Format::store(image.data(), index, count, mix(Format::load(image.data(), index, count), segment.color, coverage));
+	};
+
+	if (x_major) {
+		//Step along x, the y coordinate covers the two closest rows
+		const int32_t sx = p2.x >= p1.x ? 1 : -1;
+		const int32_t x1 = (int32_t)(p1.x + 0.5f);
+		const int64_t n = std::abs((int32_t)(p2.x + 0.5f) - x1);
+		const float gradient = p2.x == p1.x ? 0 : (p2.y - p1.y) / (p2.x - p1.x);
+		auto y_at = [&](int64_t k) { return p1.y + (x1 + sx*k - p1.x) * gradient; };
+		//floor(y_at(k)) is ascending in k, the steps touching the band are found by binary search
+		auto first_step = [&](int32_t r) {
+			if (r <= std::floor(y_at(0)))
+				return (int64_t)0;
+			if (r > std::floor(y_at(n)))
+				return n + 1;
+			int64_t low = 0, high = n + 1;
+			while (low < high) {
+				const int64_t mid = (low + high) / 2;
+				if (std::floor(y_at(mid)) < r)
+					low = mid + 1;
+				else
+					high = mid;
 			}
-			this->operator()(x, y) = color;
+			return low;
+		};
+		const int64_t k_end = first_step(row_end);
+		for (int64_t k = first_step(row_begin - 1); k < k_end; ++k) {
+			const float y = y_at(k);
+			const float row = std::floor(y);
+			blend(x1 + sx*k, (int64_t)row, 1 - (y - row));
+			blend(x1 + sx*k, (int64_t)row + 1, y - row);
+		}
+	}
+	else {
+		//Step along y, the x coordinate covers the two closest columns
+		const int32_t ry1 = (int32_t)(p1.y + 0.5f);
+		const int32_t ry2 = (int32_t)(p2.y + 0.5f);
+		const float gradient = (p2.x - p1.x) / (p2.y - p1.y);
+		for (int32_t y = std::max(ry1, row_begin); y <= std::min(ry2, row_end - 1); ++y) {
+			const float x = p1.x + (y - p1.y) * gradient;
+			const float column = std::floor(x);
+			blend((int64_t)column, y, 1 - (x - column));
+			blend((int64_t)column + 1, y, x - column);
 		}
 	}
 }
 
 
-void Bitmap::save(const std::string& path, Bitmap::Quality quality) const
+template<typename Format>
+void BasicBitmap<Format>::save(const std::string& path, Quality quality) const
 {
+	const BitmapPalette palette = generatePalette(quality);
+	const FileLayout layout = this->layout(quality, palette);
 	std::ofstream file(path, std::ofstream::out | std::ofstream::binary);
-	uint32_t bfSize;
-	uint16_t biBitCount;
-	uint32_t biCompression = 0;
-	uint32_t biClrUsed;
-
-	//Make Place for the file and info header
-	for (int i = 0; i < 54; ++i)
-		write(file, 0, 1);
-
-	//Write the color table
-	auto colortable = generateColorTable();
-	biClrUsed = colortable.size();
+
+	//The same buffer holds the headers and afterwards each row, so every part is written with one call
+	std::vector<uint8_t> buffer(std::max(layout.bfOffBits, layout.rowSize));
+	saveHeader(buffer.data(), layout, palette);
+	file.write(reinterpret_cast<const char*>(buffer.data()), layout.bfOffBits);
+	for (uint32_t y = 0; y < height; ++y) {
+		saveRow(buffer.data(), y, layout, palette);
+		file.write(reinterpret_cast<const char*>(buffer.data()), layout.rowSize);
+	}
+
+	file.close();
+}
+
+
+template<typename Format>
+bool BasicBitmap<Format>::saveMapped(const std::string& path, Quality quality) const
+{
+	const BitmapPalette palette = generatePalette(quality);
+	const FileLayout layout = this->layout(quality, palette);
+	bitmap_detail::MappedFile file(path, layout.bfSize);
+	if (!file.data())
+		return false;
+
+	saveHeader(file.data(), layout, palette);
+	for (uint32_t y = 0; y < height; ++y)
+		saveRow(file.data() + layout.bfOffBits + (size_t)y * layout.rowSize, y, layout, palette);
+	return true;
+}
+
+
+template<typename Format>
+uint32_t BasicBitmap<Format>::Width() const
+{
+	return width;
+}
+
+
+template<typename Format>
+uint32_t BasicBitmap<Format>::Height() const
+{
+	return height;
+}
+
+
+template<typename Format>
+const typename BasicBitmap<Format>::Element* BasicBitmap<Format>::data() const
+{
+	return image.data();
+}
+
+
+template<typename Format>
+Color BasicBitmap<Format>::pixel(size_t index) const
+{
+	return Format::load(image.data(), index, (size_t)width*height);
+}
+
+
+template<typename Format>
+template<typename Term>
+void BasicBitmap<Format>::assign(const Term& term)
+{
+	const size_t count = (size_t)width*height;
+	if constexpr (Format::FLOAT_CHANNELS) {
+		float* channels = Format::channels(image.data());
+		bitmap_detail::parallel_for(3 * count, [&](size_t begin, size_t end) {
+			size_t i = begin;
+#ifdef BITMAP_SIMD
+			using Simd = bitmap_detail::Simd;
+			for (; i + Simd::WIDTH <= end; i += Simd::WIDTH)
+				Simd::store(channels + i, term.template eval<Simd>(i));
+#endif
+			for (; i < end; ++i)
+				channels[i] = term.template eval<bitmap_detail::Scalar>(i);
+		});
+	}
+	else {
+		bitmap_detail::parallel_for(count, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				Format::store(image.data(), i, count, term.pixel(i));
+		});
+	}
+}
+
+
+template<typename Format>
+BasicBitmap<Format> BasicBitmap<Format>::load(const std::string& path)
+{
+	return BitmapFile(path).read<Format>();
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::getRow(uint32_t y, Color* row) const
+{
+	assert(y < height);
+	for (uint32_t x = 0; x < width; ++x)
+		row[x] = pixel((size_t)y*width + x);
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::setRow(uint32_t y, const Color* row)
+{
+	assert(y < height);
+	const size_t count = (size_t)width*height;
+	for (uint32_t x = 0; x < width; ++x)
+		Format::store(image.data(), (size_t)y*width + x, count, row[x]);
+}
+
+
+template<typename Format>
+BitmapPalette BasicBitmap<Format>::generatePalette(Quality quality) const
+{
+	//Colors are told apart at the depth they would be saved with. LOW stores fewer bits than the colortable,
+	//so the 8bit colors suffice for LOW and MEDIUM
+	const bool high = quality == Quality::HIGH;
+	const size_t count = (size_t)width*height;
+	BitmapPalette palette;
+	bitmap_detail::ColorHashTable table;
+	//Neighbouring pixels often have the same color, so the last lookup gets reused
+	uint32_t last = 0xFFFFFFFF;
+	uint8_t index = 0;
+	//The index image grows in doubling chunks, so an image with too many colors
+	//(usually found within the first rows) does not pay for an index per pixel
+	for (size_t begin = 0; begin < count;) {
+		const size_t end = std::min(count, std::max<size_t>(2 * begin, PALETTE_CHUNK));
+		palette.indices.resize(end);
+		uint8_t* indices = palette.indices.data();
+		for (size_t i = begin; i < end; ++i) {
+			const Color col = pixel(i);
+			const uint32_t key = high ? (col.intR(10) << 20) | (col.intG(10) << 10) | col.intB(10)
+				: ((uint32_t)col.intR() << 16) | ((uint32_t)col.intG() << 8) | col.intB();
+			if (key != last) {
+				const uint32_t next = palette.colors.size();
+				const uint32_t found = table.insert(key, next);
+				if (found == next) {
+					if (next == (uint32_t)MAX_COLORTABLE_SIZE)	//There are too much colors for a colortable
+						return BitmapPalette();
+					const uint32_t rgb = ((uint32_t)col.intR() << 16) | ((uint32_t)col.intG() << 8) | col.intB();
+					//The 10bit color has to be read back from its 8bit entry in the colortable
+					if (high) {
+						const Color entry(rgb);
+						if (((entry.intR(10) << 20) | (entry.intG(10) << 10) | entry.intB(10)) != key)
+							return BitmapPalette();
+					}
+					palette.colors.push_back(rgb);
+				}
+				last = key;
+				index = found;
+			}
+			indices[i] = index;
+		}
+		begin = end;
+	}
+	return palette;
+}
+
+
+template<typename Format>
+typename BasicBitmap<Format>::FileLayout BasicBitmap<Format>::layout(Quality quality, const BitmapPalette& palette) const
+{
+	FileLayout layout;
+	layout.biCompression = 0;
 	//Only use colortable if less than 256 colors are used and the colordepth is less than 256
-	biClrUsed = biClrUsed <= MAX_COLORTABLE_SIZE ? biClrUsed : 0;
+	layout.biClrUsed = palette.colors.size();
 	//Determine the colordepth
-	if (biClrUsed) {
-		if (biClrUsed <= 2)
-			biBitCount = 1;
-		else if (biClrUsed <= 16)
-			biBitCount = 4;
+	if (layout.biClrUsed) {
+		if (layout.biClrUsed <= 2)
+			layout.biBitCount = 1;
+		else if (layout.biClrUsed <= 16)
+			layout.biBitCount = 4;
 		else
-			biBitCount = 8;
+			layout.biBitCount = 8;
 	}
 	else {	//Bit Count determined by quality tag
-			if (quality == Quality::LOW)
-				biBitCount = 16;
-			else if (quality == Quality::MEDIUM)
-				biBitCount = 24;
-			else {
-				biBitCount = 32;
-				biCompression = 3;	//User defined 10bit colors
-			}
+		if (quality == Quality::LOW)
+			layout.biBitCount = 16;
+		else if (quality == Quality::MEDIUM)
+			layout.biBitCount = 24;
+		else {
+			layout.biBitCount = 32;
+			layout.biCompression = 3;	//User defined 10bit colors
 		}
-
-	//Save the bitmask if 32bits are used to achieve 10bit colors
-	if (biCompression == 3) {
-		write(file, 0x3FF00000, 4);	//Red
-		write(file, 0x000FFC00, 4);	//Green
-		write(file, 0x000003FF, 4);	//Blue
-	}
-	//Save the colortable if one should be used
-	if (biClrUsed)
-		saveColorTable(file, colortable);
-	//Save the Image Data
-	switch (biBitCount) {
-	case 1:
-		saveImageData1bpp(file, colortable);
-		break;
-	case 4:
-		saveImageData4bpp(file, colortable);
-		break;
-	case 8:
-		saveImageData8bpp(file, colortable);
-		break;
-	case 16:
-		saveImageData16bpp(file);
-		break;
-	case 24:
-		saveImageData24bpp(file);
-		break;
-	case 32:
-		saveImageData32bpp(file);
-		break;
 	}
-	
-	//Write the file and info headers
-	bfSize = file.tellp();	//Get the file size
-	file.seekp(0);
 
+	//The bitmasks for the 10bit colors follow directly after the info header
+	layout.bfOffBits = 54 + layout.biClrUsed * 4 + (layout.biCompression == 3 ? 12 : 0);
+	layout.rowSize = ceil4((width * layout.biBitCount + 7) / 8);
+	layout.bfSize = layout.bfOffBits + height * layout.rowSize;
+	return layout;
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::saveHeader(uint8_t* dst, const FileLayout& layout, const BitmapPalette& palette) const
+{
 	//Fileheader
 	//bfType
-	write(file, 'B', 1);
-	write(file, 'M', 1);
+	dst = write(dst, 'B', 1);
+	dst = write(dst, 'M', 1);
 	//bfSize
-	write(file, bfSize, 4);
+	dst = write(dst, layout.bfSize, 4);
 	//bfReserved
-	write(file, 0, 4);
+	dst = write(dst, 0, 4);
 	//bfOffBits
-	write(file, 54 + biClrUsed * 4, 4);
-	
+	dst = write(dst, layout.bfOffBits, 4);
+
 	//Infoheader
 	//biSize
-	write(file, 40, 4);
+	dst = write(dst, 40, 4);
 	//biWidth
-	write(file, width, 4);
+	dst = write(dst, width, 4);
 	//biHeight
-	write(file, height, 4);
+	dst = write(dst, height, 4);
 	//biPlanes
-	write(file, 1, 2);
+	dst = write(dst, 1, 2);
 	//biBitCount
-	write(file, biBitCount, 2);
+	dst = write(dst, layout.biBitCount, 2);
 	//biCompression
-	write(file, biCompression, 4);
+	dst = write(dst, layout.biCompression, 4);
 	//bfSizeImage
-	write(file, bfSize - 54 - biClrUsed * 4 , 4);
+	dst = write(dst, layout.bfSize - layout.bfOffBits, 4);
 	//biXPelsPerMeter
-	write(file, 0, 4);
+	dst = write(dst, 0, 4);
 	//biYPelsPerMeter
-	write(file, 0, 4);
+	dst = write(dst, 0, 4);
 	//biClrUsed
-	write(file, biClrUsed, 4);
+	dst = write(dst, layout.biClrUsed, 4);
 	//biClrImportant
-	write(file, 0, 4);
+	dst = write(dst, 0, 4);
 
-	file.close();
+	//Save the bitmask if 32bits are used to achieve 10bit colors
+	if (layout.biCompression == 3) {
+		dst = write(dst, 0x3FF00000, 4);	//Red
+		dst = write(dst, 0x000FFC00, 4);	//Green
+		dst = write(dst, 0x000003FF, 4);	//Blue
+	}
+	//Save the colortable if one should be used
+	if (layout.biClrUsed)
+		saveColorTable(dst, palette);
 }
 
 
-inline uint32_t Bitmap::Width() const
+template<typename Format>
+void BasicBitmap<Format>::saveColorTable(uint8_t* dst, const BitmapPalette& palette) const
 {
-	return width;
+	//Every entry is stored as blue, green, red and a reserved zero byte
+	for (uint32_t rgb : palette.colors)
+		dst = write(dst, rgb, 4);
 }
 
 
-inline uint32_t Bitmap::Height() const
+template<typename Format>
+void BasicBitmap<Format>::saveRow(uint8_t* dst, uint32_t y, const FileLayout& layout, const BitmapPalette& palette) const
 {
-	return height;
+	//Zero the padding and the bits of partially used bytes
+	std::memset(dst, 0, layout.rowSize);
+	switch (layout.biBitCount) {
+	case 1:
+		saveRow1bpp(dst, y, palette);
+		break;
+	case 4:
+		saveRow4bpp(dst, y, palette);
+		break;
+	case 8:
+		saveRow8bpp(dst, y, palette);
+		break;
+	case 16:
+		saveRow16bpp(dst, y);
+		break;
+	case 24:
+		saveRow24bpp(dst, y);
+		break;
+	case 32:
+		saveRow32bpp(dst, y);
+		break;
+	}
 }
 
 
-inline std::unordered_map<Color, uint8_t> Bitmap::generateColorTable() const
+template<typename Format>
+void BasicBitmap<Format>::saveRow1bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const
 {
-	std::unordered_map<Color, uint8_t> colortable;
-	for (const Color& col : image) {
-		if (!colortable.count(col))
-			colortable.insert({ col, colortable.size() });
-		if (colortable.size() > MAX_COLORTABLE_SIZE)	//Break, as there are too much colors for a colortable anyway
-			break;
-	}
-	return colortable;
+	const size_t row = (size_t)y * width;
+	for (uint32_t x = 0; x < width; ++x)
+		dst[x / 8] |= (palette.indices[row + x] & 0x01) << (7 - x % 8);
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::saveRow4bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const
+{
+	const size_t row = (size_t)y * width;
+	for (uint32_t x = 0; x < width; ++x)
+		dst[x / 2] |= (palette.indices[row + x] & 0x0F) << (x % 2 ? 0 : 4);
 }
 
 
-inline void Bitmap::saveColorTable(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const
+template<typename Format>
+void BasicBitmap<Format>::saveRow8bpp(uint8_t* dst, uint32_t y, const BitmapPalette& palette) const
 {
-	//Write the colortable into a vector
-	std::vector<Color> table(colortable.size());
-	for (const auto& col : colortable)
-		table[col.second] = col.first;
-	//Write the table inside the vector to os
-	for (const Color& col : table) {
-		write(os, col.intB(), 1);
-		write(os, col.intG(), 1);
-		write(os, col.intR(), 1);
-		write(os, 0x00, 1);
+	std::memcpy(dst, palette.indices.data() + (size_t)y * width, width);
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::saveRow16bpp(uint8_t* dst, uint32_t y) const
+{
+	const size_t row = (size_t)y * width;
+	for (uint32_t x = 0; x < width; ++x) {
+		const Color col = pixel(row + x);
+		uint16_t color = 0x0000;
+		color |= 0x7C00 & (col.intR(5) << 10);	//Red
+		color |= 0x03E0 & (col.intG(5) << 5);	//Green
+		color |= 0x001F & (col.intB(5) << 0);	//Blue
+		dst = write(dst, color, 2);
 	}
 }
 
 
-inline void Bitmap::saveImageData1bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const
+template<typename Format>
+void BasicBitmap<Format>::saveRow24bpp(uint8_t* dst, uint32_t y) const
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; x += 8) {
-			uint8_t byte = 0x00;
-			byte |= x + 0 < width ? (colortable.at(this->operator()(x + 0, y)) << 7) : 0;
-			byte |= x + 1 < width ? (colortable.at(this->operator()(x + 1, y)) << 6) : 0;
-			byte |= x + 2 < width ? (colortable.at(this->operator()(x + 2, y)) << 5) : 0;
-			byte |= x + 3 < width ? (colortable.at(this->operator()(x + 3, y)) << 4) : 0;
-			byte |= x + 4 < width ? (colortable.at(this->operator()(x + 4, y)) << 3) : 0;
-			byte |= x + 5 < width ? (colortable.at(this->operator()(x + 5, y)) << 2) : 0;
-			byte |= x + 6 < width ? (colortable.at(this->operator()(x + 6, y)) << 1) : 0;
-			byte |= x + 7 < width ? (colortable.at(this->operator()(x + 7, y)) << 0) : 0;
-			write(os, byte, 1);
-		}
-		//Pad to a multiple of 4 bytes
-		write(os, 0, ceil4(std::ceil(((double)width) / 8)) - std::ceil(((double)width) / 8));
+	const size_t row = (size_t)y * width;
+	for (uint32_t x = 0; x < width; ++x) {
+		const Color col = pixel(row + x);
+		dst[0] = col.intB();
+		dst[1] = col.intG();
+		dst[2] = col.intR();
+		dst += 3;
 	}
 }
 
 
-inline void Bitmap::saveImageData4bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const
+template<typename Format>
+void BasicBitmap<Format>::saveRow32bpp(uint8_t* dst, uint32_t y) const
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; x += 2) {
-			uint8_t byte = 0x00;
-			byte |= x + 0 < width ? (0xF0 & (colortable.at(this->operator()(x + 0, y)) << 4)) : 0;
-			byte |= x + 1 < width ? (0x0F & (colortable.at(this->operator()(x + 1, y)) << 0)) : 0;
-			write(os, byte, 1);
-		}
-		//Pad to a multiple of 4 bytes
-		write(os, 0, ceil4(std::ceil(((double)width) / 2)) - std::ceil(((double)width) / 2));
+	const size_t row = (size_t)y * width;
+	for (uint32_t x = 0; x < width; ++x) {
+		const Color col = pixel(row + x);
+		uint32_t color = 0x00000000;
+		color |= 0x000003FF & (col.intB(10) <<  0);
+		color |= 0x000FFC00 & (col.intG(10) << 10);
+		color |= 0x3FF00000 & (col.intR(10) << 20);
+		dst = write(dst, color, 4);
 	}
 }
 
 
-inline void Bitmap::saveImageData8bpp(std::ostream& os, const std::unordered_map<Color, uint8_t>& colortable) const
+template<typename Format>
+template<typename T>
+uint8_t* BasicBitmap<Format>::write(uint8_t* dst, T value, int length)
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			write(os, colortable.at(this->operator()(x, y)), 1);
-		}
-		//Pad to a multiple of 4 bytes
-		write(os, 0, ceil4(width) - width);
+	while (length--) {
+		*dst++ = (uint8_t)value;
+		value >>= 8;
 	}
+	return dst;
 }
 
 
-inline void Bitmap::saveImageData16bpp(std::ostream& os) const
+template<typename Format>
+uint32_t BasicBitmap<Format>::ceil4(uint32_t n) const
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			uint16_t color = 0x0000;
-			color |= 0x7C00 & (this->operator()(x, y).intR(5) << 10);	//Red
-			color |= 0x03E0 & (this->operator()(x, y).intG(5) << 5);	//Green
-			color |= 0x001F & (this->operator()(x, y).intB(5) << 0);	//Blue
-			write(os, color, 2);
-		}
-		//Pad to a multiple of 4 bytes
-		uint32_t bpr = 2 * width;	//Bytes per Row
-		write(os, 0, ceil4(bpr) - bpr);
+	return (uint32_t)(4*std::ceil(((double)n)/4));
+}
+
+
+template<typename Format>
+void BasicBitmap<Format>::swap(BasicBitmap& other)
+{
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(image, other.image);
+}
+
+
+
+//---------- BitmapFile Implementation ----------//
+
+inline BitmapFile::BitmapFile(const std::string& path) : file(path)
+{
+	const uint8_t* data = file.data();
+	const size_t size = file.size();
+	if (!data)
+		throw std::runtime_error("Cannot open " + path);
+	if (size < 54 || data[0] != 'B' || data[1] != 'M')
+		throw std::runtime_error(path + " is not a BMP file");
+
+	//Fileheader and Infoheader
+	const uint32_t bfOffBits = read(data + 10, 4);
+	const uint32_t biSize = read(data + 14, 4);
+	const int32_t biWidth = (int32_t)read(data + 18, 4);
+	const int32_t biHeight = (int32_t)read(data + 22, 4);
+	bit_count = read(data + 28, 2);
+	const uint32_t biCompression = read(data + 30, 4);
+	uint32_t biClrUsed = read(data + 46, 4);
+	if (biSize < 40 || biWidth < 0 || biWidth == INT32_MIN || biHeight == INT32_MIN)
+		throw std::runtime_error(path + " has an unsupported header");
+	width = biWidth;
+	height = std::abs(biHeight);
+	top_down = biHeight < 0;
+	if (bit_count != 1 && bit_count != 4 && bit_count != 8 && bit_count != 16 && bit_count != 24 && bit_count != 32)
+		throw std::runtime_error(path + " has an unsupported colordepth");
+	//Only uncompressed data and bitmasks for 16 and 32 bits per pixel are supported
+	if (biCompression != 0 && !(biCompression == 3 && (bit_count == 16 || bit_count == 32)))
+		throw std::runtime_error(path + " uses an unsupported compression");
+
+	//The bitmasks are stored directly after the Infoheader or are part of it
+	if (biCompression == 3) {
+		if (size < 66)
+			throw std::runtime_error(path + " is truncated");
+		for (int c = 0; c < 3; ++c)
+			masks[c] = read(data + 54 + 4 * c, 4);
+	}
+	else if (bit_count == 16) {
+		masks[0] = 0x7C00;
+		masks[1] = 0x03E0;
+		masks[2] = 0x001F;
+	}
+	else {
+		masks[0] = 0x00FF0000;
+		masks[1] = 0x0000FF00;
+		masks[2] = 0x000000FF;
+	}
+	for (int c = 0; c < 3; ++c) {
+		shifts[c] = 0;
+		while (masks[c] && !((masks[c] >> shifts[c]) & 1))
+			++shifts[c];
+		scales[c] = masks[c] ? 1.0f / (masks[c] >> shifts[c]) : 0.0f;
 	}
+
+	//Colortable
+	if (bit_count <= 8) {
+		if (biClrUsed == 0 || biClrUsed > (1u << bit_count))
+			biClrUsed = 1u << bit_count;
+		const size_t offset = 14 + biSize + (biSize == 40 && biCompression == 3 ? 12 : 0);
+		if (offset + 4 * biClrUsed > size)
+			throw std::runtime_error(path + " is truncated");
+		colortable.resize(biClrUsed);
+		for (uint32_t i = 0; i < biClrUsed; ++i)
+			colortable[i] = Color(read(data + offset + 4 * i, 3));
+	}
+
+	row_size = ((uint64_t)width * bit_count + 31) / 32 * 4;
+	if (bfOffBits > size || (uint64_t)row_size * height > size - bfOffBits)
+		throw std::runtime_error(path + " is truncated");
+	pixels = data + bfOffBits;
 }
 
 
-inline void Bitmap::saveImageData24bpp(std::ostream& os) const
+inline uint32_t BitmapFile::Width() const
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			write(os, this->operator()(x, y).intB(), 1);
-			write(os, this->operator()(x, y).intG(), 1);
-			write(os, this->operator()(x, y).intR(), 1);
-		}
-		//Pad to a multiple of 4 bytes
-		uint32_t bpr = 3 * width;	//Bytes per Row
-		write(os, 0, ceil4(bpr) - bpr);
+	return width;
+}
+
+
+inline uint32_t BitmapFile::Height() const
+{
+	return height;
+}
+
+
+inline uint16_t BitmapFile::BitCount() const
+{
+	return bit_count;
+}
+
+
+inline Color BitmapFile::operator()(uint32_t x, uint32_t y) const
+{
+	assert(x < width && y < height);
+	return decode(row(y), x);
+}
+
+
+inline void BitmapFile::readRow(uint32_t y, Color* dst) const
+{
+	assert(y < height);
+	const uint8_t* src = row(y);
+	switch (bit_count) {
+	case 8:
+		for (uint32_t x = 0; x < width; ++x)
+			dst[x] = colortable[std::min<size_t>(src[x], colortable.size() - 1)];
+		break;
+	case 24:
+		for (uint32_t x = 0; x < width; ++x, src += 3)
+			dst[x] = Color(read(src, 3));
+		break;
+	default:
+		for (uint32_t x = 0; x < width; ++x)
+			dst[x] = decode(src, x);
 	}
 }
 
 
-inline void Bitmap::saveImageData32bpp(std::ostream& os) const
+template<typename Format>
+BasicBitmap<Format> BitmapFile::read() const
 {
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			uint32_t color = 0x00000000;
-			color |= 0x000003FF & (this->operator()(x, y).intB(10) <<  0);
-			color |= 0x000FFC00 & (this->operator()(x, y).intG(10) << 10);
-			color |= 0x3FF00000 & (this->operator()(x, y).intR(10) << 20);
-			write(os, color, 4);
+	BasicBitmap<Format> image(width, height);
+	//Decode multiple rows in parallel, each thread with its own row buffer
+	bitmap_detail::parallel_for(height, [&](size_t begin, size_t end) {
+		std::vector<Color> buffer(width);
+		for (size_t y = begin; y < end; ++y) {
+			readRow(y, buffer.data());
+			image.setRow(y, buffer.data());
 		}
-	}
+	}, std::max<size_t>(1, bitmap_detail::PARALLEL_GRAIN / std::max<uint32_t>(1, width)));
+	return image;
 }
 
 
-template<typename T>
-inline std::ostream& Bitmap::write(std::ostream& os, T value, int length) const
+inline const uint8_t* BitmapFile::row(uint32_t y) const
 {
-	while (length--) {
-		os.put((uint8_t)value);
-		value >>= 8;
+	//Rows are stored from the bottom to the top, unless the height is negative
+	return pixels + (size_t)(top_down ? height - 1 - y : y) * row_size;
+}
+
+
+inline Color BitmapFile::decode(const uint8_t* src, uint32_t x) const
+{
+	switch (bit_count) {
+	case 1:
+		return colortable[std::min<size_t>((src[x / 8] >> (7 - x % 8)) & 0x01, colortable.size() - 1)];
+	case 4:
+		return colortable[std::min<size_t>((src[x / 2] >> (x % 2 ? 0 : 4)) & 0x0F, colortable.size() - 1)];
+	case 8:
+		return colortable[std::min<size_t>(src[x], colortable.size() - 1)];
+	case 24:
+		return Color(read(src + 3 * x, 3));
+	default: {
+		const uint32_t value = read(src + (bit_count / 8) * x, bit_count / 8);
+		auto channel = [&](int c) {
+			const uint32_t bits = (value & masks[c]) >> shifts[c];
+			float channel = bits * scales[c];
+			//Make sure that Color::intR etc. return the stored bits again despite the rounding of the division
+			if ((uint32_t)((masks[c] >> shifts[c]) * channel) < bits)
+				channel = std::nextafter(channel, 1.0f);
+			return channel;
+		};
+		return Color(channel(0), channel(1), channel(2));
+	}
 	}
-	return os;
 }
 
 
-uint32_t Bitmap::ceil4(uint32_t n) const
+inline uint32_t BitmapFile::read(const uint8_t* src, int length)
 {
-	return (uint32_t)(4*std::ceil(((double)n)/4));
+	//Little endian byte order
+	uint32_t value = 0;
+	for (int i = length - 1; i >= 0; --i)
+		value = (value << 8) | src[i];
+	return value;
 }
 
 
-inline void Bitmap::swap(Bitmap& other)
+
+//---------- PixelReference and MappedFile Implementation ----------//
+
+namespace bitmap_detail
 {
-	std::swap(width, other.width);
-	std::swap(height, other.height);
-	std::swap(image, other.image);
-}
\ No newline at end of file
+	inline ColorHashTable::ColorHashTable()
+	{
+		std::fill_n(keys, SIZE, EMPTY);
+	}
+
+
+	inline uint32_t ColorHashTable::insert(uint32_t rgb, uint32_t next)
+	{
+		//Fibonacci hashing followed by linear probing
+		size_t slot = (rgb * 0x9E3779B1u) >> 22;
+		while (keys[slot] != EMPTY) {
+			if (keys[slot] == rgb)
+				return values[slot];
+			slot = (slot + 1) & (SIZE - 1);
+		}
+		keys[slot] = rgb;
+		values[slot] = next;
+		return next;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>::PixelReference(typename Format::Element* data, size_t index, size_t count) : data(data), index(index), count(count)
+	{
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator=(const PixelReference& other)
+	{
+		return *this = (Color)other;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator=(const Color& color)
+	{
+		Format::store(data, index, count, color);
+		return *this;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator+=(const Color& other)
+	{
+		return *this = (Color)*this + other;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator-=(const Color& other)
+	{
+		return *this = (Color)*this - other;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator*=(const Color& other)
+	{
+		return *this = (Color)*this * other;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>& PixelReference<Format>::operator*=(float fac)
+	{
+		Color col = *this;
+		col *= fac;
+		return *this = col;
+	}
+
+
+	template<typename Format>
+	PixelReference<Format>::operator Color() const
+	{
+		return Format::load(data, index, count);
+	}
+
+
+	inline MappedFile::MappedFile(const std::string& path, size_t size) : ptr(nullptr), length(size)
+	{
+#if defined(_WIN32)
+		mapping = NULL;
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+		if (mapping)
+			ptr = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+#else
+		file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (file < 0)
+			return;
+		if (ftruncate(file, size) == 0) {
+			void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			ptr = mapped == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mapped);
+		}
+#endif
+	}
+
+
+	inline MappedFile::MappedFile(const std::string& path) : ptr(nullptr), length(0)
+	{
+#if defined(_WIN32)
+		mapping = NULL;
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+			return;
+		length = (size_t)size.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+			ptr = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, length));
+#else
+		file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return;
+		struct stat status;
+		if (fstat(file, &status) == 0 && status.st_size > 0) {
+			length = status.st_size;
+			void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+			ptr = mapped == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mapped);
+		}
+#endif
+	}
+
+
+	inline MappedFile::~MappedFile()
+	{
+#if defined(_WIN32)
+		if (ptr)
+			UnmapViewOfFile(ptr);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (ptr)
+			munmap(ptr, length);
+		if (file >= 0)
+			close(file);
+#endif
+	}
+
+
+	inline uint8_t* MappedFile::data() const
+	{
+		return ptr;
+	}
+
+
+	inline size_t MappedFile::size() const
+	{
+		return length;
+	}
+}
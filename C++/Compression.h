@@ -10,88 +10,505 @@
 #include <iostream>
 #include <unordered_map>
 #include <algorithm>
+#include <iterator>
+#include <cassert>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 //Run Length Encoding (RLE)
 namespace RLE
 {
 
+	//Contains the vectorized run detection used by the encoder
+	namespace detail
+	{
+		//Returns the number of trailing zero bits of n (n != 0)
+		inline int countTrailingZeros(uint64_t n)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward64(&index, n);
+			return (int)index;
+#else
+			return __builtin_ctzll(n);
+#endif
+		}
+
+
+		//Compares vectors of elements and returns a bitmask of the result
+		//Every equal element sets MASK_BITS_PER_BYTE * sizeof(T) consecutive bits in the mask
+#if defined(__AVX2__)
+#define RLE_SIMD
+		struct Simd
+		{
+			using vector = __m256i;
+			static constexpr size_t BYTES = 32;
+			static constexpr int MASK_BITS_PER_BYTE = 1;
+
+			static vector load(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+
+			template<typename T>
+			static vector broadcast(T value)
+			{
+				if constexpr (sizeof(T) == 1) return _mm256_set1_epi8((char)value);
+				else if constexpr (sizeof(T) == 2) return _mm256_set1_epi16((short)value);
+				else if constexpr (sizeof(T) == 4) return _mm256_set1_epi32((int)value);
+				else return _mm256_set1_epi64x((long long)value);
+			}
+
+			template<typename T>
+			static uint64_t equal(vector a, vector b)
+			{
+				if constexpr (sizeof(T) == 1) return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+				else if constexpr (sizeof(T) == 2) return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b));
+				else if constexpr (sizeof(T) == 4) return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b));
+				else return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi64(a, b));
+			}
+		};
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RLE_SIMD
+		struct Simd
+		{
+			using vector = __m128i;
+			static constexpr size_t BYTES = 16;
+			static constexpr int MASK_BITS_PER_BYTE = 1;
+
+			static vector load(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+
+			template<typename T>
+			static vector broadcast(T value)
+			{
+				if constexpr (sizeof(T) == 1) return _mm_set1_epi8((char)value);
+				else if constexpr (sizeof(T) == 2) return _mm_set1_epi16((short)value);
+				else if constexpr (sizeof(T) == 4) return _mm_set1_epi32((int)value);
+				else return _mm_set_epi32((int)((uint64_t)value >> 32), (int)value, (int)((uint64_t)value >> 32), (int)value);
+			}
+
+			template<typename T>
+			static uint64_t equal(vector a, vector b)
+			{
+				if constexpr (sizeof(T) == 1) return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+				else if constexpr (sizeof(T) == 2) return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(a, b));
+				else if constexpr (sizeof(T) == 4) return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi32(a, b));
+				else {	//SSE2 has no 64 bit comparison, both 32 bit halves have to be equal
+					vector eq = _mm_cmpeq_epi32(a, b);
+					return (uint32_t)_mm_movemask_epi8(_mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1))));
+				}
+			}
+		};
+#elif defined(__ARM_NEON)
+#define RLE_SIMD
+		struct Simd
+		{
+			using vector = uint8x16_t;
+			static constexpr size_t BYTES = 16;
+			static constexpr int MASK_BITS_PER_BYTE = 4;
+
+			static vector load(const void* p) { return vld1q_u8((const uint8_t*)p); }
+
+			template<typename T>
+			static vector broadcast(T value)
+			{
+				if constexpr (sizeof(T) == 1) return vdupq_n_u8((uint8_t)value);
+				else if constexpr (sizeof(T) == 2) return vreinterpretq_u8_u16(vdupq_n_u16((uint16_t)value));
+				else if constexpr (sizeof(T) == 4) return vreinterpretq_u8_u32(vdupq_n_u32((uint32_t)value));
+				else return vreinterpretq_u8_u64(vdupq_n_u64((uint64_t)value));
+			}
+
+			template<typename T>
+			static uint64_t equal(vector a, vector b)
+			{
+				uint8x16_t eq;
+				if constexpr (sizeof(T) == 1) eq = vceqq_u8(a, b);
+				else if constexpr (sizeof(T) == 2) eq = vreinterpretq_u8_u16(vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+				else if constexpr (sizeof(T) == 4) eq = vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)));
+				else {	//Both 32 bit halves have to be equal
+					uint32x4_t eq32 = vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b));
+					eq = vreinterpretq_u8_u32(vandq_u32(eq32, vrev64q_u32(eq32)));
+				}
+				//Narrow every byte to 4 bits, as NEON has no movemask
+				return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+			}
+		};
+#endif
+
+
+		//Returns the number of elements at the start of [data, data + size) which are equal to value
+		template<typename T>
+		size_t countEqual(const T* data, size_t size, T value)
+		{
+			size_t i = 0;
+#ifdef RLE_SIMD
+			constexpr size_t ELEMENTS = Simd::BYTES / sizeof(T);
+			constexpr int BITS_PER_ELEMENT = Simd::MASK_BITS_PER_BYTE * sizeof(T);
+			constexpr uint64_t ALL_EQUAL = ELEMENTS * BITS_PER_ELEMENT == 64 ? ~uint64_t(0) : (uint64_t(1) << (ELEMENTS * BITS_PER_ELEMENT)) - 1;
+			const Simd::vector v = Simd::broadcast(value);
+			for (; i + ELEMENTS <= size; i += ELEMENTS) {
+				uint64_t mask = Simd::equal<T>(Simd::load(data + i), v);
+				if (mask != ALL_EQUAL)
+					return i + countTrailingZeros(~mask) / BITS_PER_ELEMENT;
+			}
+#endif
+			while (i < size && data[i] == value)
+				++i;
+			return i;
+		}
+
+
+		//Returns the number of elements at the start of [data, data + size) which differ from their successor
+		//As the last element has no successor, the result is at most size - 1
+		template<typename T>
+		size_t countLiterals(const T* data, size_t size)
+		{
+			size_t i = 0;
+#ifdef RLE_SIMD
+			constexpr size_t ELEMENTS = Simd::BYTES / sizeof(T);
+			constexpr int BITS_PER_ELEMENT = Simd::MASK_BITS_PER_BYTE * sizeof(T);
+			for (; i + ELEMENTS < size; i += ELEMENTS) {
+				uint64_t mask = Simd::equal<T>(Simd::load(data + i), Simd::load(data + i + 1));
+				if (mask)
+					return i + countTrailingZeros(mask) / BITS_PER_ELEMENT;
+			}
+#endif
+			while (i + 1 < size && data[i] != data[i + 1])
+				++i;
+			return i;
+		}
+	}
+
+
+	//Stateful encoder for data arriving in chunks
+	//The current run and its count are carried over from one chunk to the next,
+	//so pushing the chunks one after the other produces the same output as compress()
+	//on the concatenated data without having to keep all of it in memory.
+	//The output is written to an output iterator (a pointer into a buffer, std::back_inserter, ...)
+	template<typename T>
+	class Encoder
+	{
+		static_assert(std::numeric_limits<T>::is_integer, "Can only compress Integer Datatypes!");
+
+	public:
+		//Encodes the elements in [begin, end) and writes every finished run to out
+		//At most 2 * (end - begin) elements are written, as the last run stays open
+		//Contiguous input (pointers and std::vector iterators) is scanned for runs with SIMD instructions
+		template<typename Iterator, typename OutputIterator>
+		OutputIterator push(Iterator begin, Iterator end, OutputIterator out);
+		//Writes the run which is still open (at most 2 elements)
+		//Afterwards, the encoder can be used for new data
+		template<typename OutputIterator>
+		OutputIterator finish(OutputIterator out);
+
+	private:
+		using utype = typename std::make_unsigned<T>::type;	//Unsigned version of T (Used for counting reoccurances)
+		static constexpr utype MSB = utype(1) << (std::numeric_limits<utype>::digits - 1);
+		static constexpr utype MAX_COUNT = std::numeric_limits<utype>::max() >> 1;
+
+		T last_element = T();
+		utype count = 0;	//0 if there is no open run
+
+		template<typename OutputIterator>
+		OutputIterator pushContiguous(const T* begin, const T* end, OutputIterator out);
+		template<typename OutputIterator>
+		OutputIterator writeRun(OutputIterator out) const;
+	};
+
+
+	//Stateful decoder for data arriving in chunks
+	//A counter at the end of a chunk, as well as a run which did not fit into the output buffer,
+	//is remembered and continued with the next call to push
+	template<typename T>
+	class Decoder
+	{
+		static_assert(std::numeric_limits<T>::is_integer, "Can only decompress Integer Datatypes!");
+
+	public:
+		//Decodes all elements in [begin, end) and writes the decoded data to out
+		template<typename Iterator, typename OutputIterator>
+		OutputIterator push(Iterator begin, Iterator end, OutputIterator out);
+		//Decodes elements from [begin, end) until either all of them are consumed or the output buffer
+		//[out, out_end) is full. out is advanced past the written elements.
+		//Returns an iterator to the first element which has not been consumed yet
+		template<typename Iterator>
+		Iterator push(Iterator begin, Iterator end, T*& out, T* out_end);
+		//Returns true if the data pushed so far ended in the middle of a run
+		bool pending() const;
+
+	private:
+		using utype = typename std::make_unsigned<T>::type;	//Unsigned version of T (Used for interpreting count variables)
+		static constexpr utype MSB = utype(1) << (std::numeric_limits<utype>::digits - 1);
+
+		T value = T();
+		utype remaining = 0;	//How many times value still has to be written
+		utype counter = 0;		//A counter whose value has not been read yet (0 if there is none)
+	};
+
+
+
 	//Performs Run Length Encoding (RLE-Compression) on a container of integer scalars
 	//Uses the MSB as an indicator for repetitions:
 	//	1: The current value is a counter telling how many times the next element should be repeated
 	//	0: The current value can be copied as is in the decoded array
 	template<typename Iterator>
-	std::vector<typename Iterator::value_type> compress(Iterator begin, Iterator end)
+	std::vector<typename std::iterator_traits<Iterator>::value_type> compress(Iterator begin, Iterator end)
 	{
-		static_assert(std::numeric_limits<typename Iterator::value_type>::is_integer, "Can only compress Integer Datatypes!");
+		static_assert(std::numeric_limits<typename std::iterator_traits<Iterator>::value_type>::is_integer, "Can only compress Integer Datatypes!");
 
-		//Some useful declarations
-		using stype = typename Iterator::value_type;
-		using utype = typename std::make_unsigned<stype>::type;	//Unsigned version of the iterator value type (Used for counting reoccurances)
-		const utype MSB = 1 << (std::numeric_limits<utype>::digits - 1);
-		const utype MAX_COUNT = std::numeric_limits<utype>::max() >> 1;
+		using stype = typename std::iterator_traits<Iterator>::value_type;
 
 		std::vector<stype> encoded;
-		utype count = 1;
-		stype last_element = *begin;
-
-		//Compress all but the last element
-		for (Iterator it = begin + 1 ; it != end ; ++it) {
-			//If the element has to be stored
-			if (*it != last_element || count == MAX_COUNT) {
-				//Special case for only one occurance
-				if (count == 1 && !(last_element & MSB))
-					encoded.push_back(last_element);
-				else {
-					encoded.push_back(MSB | count);
-					encoded.push_back(last_element);
-				}
-				last_element = *it;
+		Encoder<stype> encoder;
+		encoder.finish(encoder.push(begin, end, std::back_inserter(encoded)));
+
+		return encoded;
+	}
+
+
+	//Returns the number of elements the RLE compressed data in [begin, end) decodes to
+	//Only the counters are read, so this is much cheaper than decoding the data.
+	//A counter at the end without its element is ignored, as decompress does
+	template<typename T>
+	size_t decompressedSize(const T* begin, const T* end)
+	{
+		static_assert(std::numeric_limits<T>::is_integer, "Can only decompress Integer Datatypes!");
+
+		using utype = typename std::make_unsigned<T>::type;
+		constexpr utype MSB = utype(1) << (std::numeric_limits<utype>::digits - 1);
+
+		size_t size = 0;
+		for (const T* it = begin; it < end; ++it) {
+			if (utype(*it) & MSB) {	//A counter followed by the repeated element
+				if (it + 1 == end)
+					break;
+				size += utype(*it) - MSB;
+				++it;
+			}
+			else
+				++size;
+		}
+		return size;
+	}
+
+
+	//Decompresses the RLE compressed data in [begin, end) into the buffer starting at out
+	//The buffer has to hold at least decompressedSize(begin, end) elements.
+	//Data ending with a counter (which Decoder::pending() reports) is truncated before it.
+	//No memory is allocated, runs are written with std::fill_n and stretches of
+	//uncompressed elements are copied with a single memcpy.
+	//Returns a pointer past the last element written
+	template<typename T>
+	T* decompress(const T* begin, const T* end, T* out)
+	{
+		static_assert(std::numeric_limits<T>::is_integer, "Can only decompress Integer Datatypes!");
+
+		using utype = typename std::make_unsigned<T>::type;
+		constexpr utype MSB = utype(1) << (std::numeric_limits<utype>::digits - 1);
+
+		const T* it = begin;
+		while (it != end) {
+			//Find the end of the stretch of elements which can be copied as they are
+			const T* literals = it;
+			while (it != end && !(utype(*it) & MSB))
+				++it;
+			if (it != literals) {
+				std::memcpy(out, literals, (it - literals) * sizeof(T));
+				out += it - literals;
+			}
+			if (it == end)
+				break;
+			//*it is a counter for the element following it
+			const utype count = utype(*it) - MSB;
+			assert(it + 1 != end && "The compressed data ends with a counter");
+			if (it + 1 == end)
+				break;
+			out = std::fill_n(out, count, it[1]);
+			it += 2;
+		}
+		return out;
+	}
+
+
+	//Decompresses data which was compressed with RLE
+	template<typename Iterator>
+	std::vector<typename std::iterator_traits<Iterator>::value_type> decompress(Iterator begin, Iterator end)
+	{
+		static_assert(std::numeric_limits<typename std::iterator_traits<Iterator>::value_type>::is_integer, "Can only decompress Integer Datatypes!");
+
+		using stype = typename std::iterator_traits<Iterator>::value_type;
+
+		std::vector<stype> decoded;
+		//Contiguous data is decoded into a vector of the exact size
+		if constexpr (std::is_pointer<Iterator>::value ||
+		              std::is_same<Iterator, typename std::vector<stype>::iterator>::value ||
+		              std::is_same<Iterator, typename std::vector<stype>::const_iterator>::value) {
+			if (begin == end)
+				return decoded;
+			const stype* first = &*begin;
+			const stype* last = first + (end - begin);
+			decoded.resize(decompressedSize(first, last));
+			decompress(first, last, decoded.data());
+		}
+		else {
+			Decoder<stype> decoder;
+			decoder.push(begin, end, std::back_inserter(decoded));
+		}
+
+		return decoded;
+	}
+
+
+
+	//---------- Encoder Implementation ----------//
+
+	template<typename T>
+	template<typename Iterator, typename OutputIterator>
+	OutputIterator Encoder<T>::push(Iterator begin, Iterator end, OutputIterator out)
+	{
+		if constexpr (std::is_pointer<Iterator>::value)
+			return pushContiguous(begin, end, out);
+		else if constexpr (std::is_same<Iterator, typename std::vector<T>::iterator>::value ||
+		                   std::is_same<Iterator, typename std::vector<T>::const_iterator>::value)
+			return begin == end ? out : pushContiguous(&*begin, &*begin + (end - begin), out);
+		for (Iterator it = begin; it != end; ++it) {
+			//If the open run has to be stored
+			if (count && (*it != last_element || count == MAX_COUNT)) {
+				out = writeRun(out);
 				count = 0;
 			}
+			last_element = *it;
 			++count;
 		}
-		//Add the last element to the compressed vector
-		if (count == 1 && !(last_element & MSB))
-			encoded.push_back(last_element);
-		else {
-			encoded.push_back(MSB | count);
-			encoded.push_back(last_element);
+		return out;
+	}
+
+
+	template<typename T>
+	template<typename OutputIterator>
+	OutputIterator Encoder<T>::pushContiguous(const T* begin, const T* end, OutputIterator out)
+	{
+		const T* it = begin;
+		while (it != end) {
+			if (count) {
+				//Extend the open run as far as possible
+				size_t n = detail::countEqual(it, (size_t)std::min<uint64_t>(end - it, MAX_COUNT - count), last_element);
+				count += (utype)n;
+				it += n;
+				if (it == end)
+					break;
+				//Either a different element follows or the counter is full
+				out = writeRun(out);
+				count = 0;
+			}
+			//Store all elements which differ from their successor as runs of length one
+			size_t n = detail::countLiterals(it, end - it);
+			for (size_t i = 0; i < n; ++i) {
+				last_element = it[i];
+				count = 1;
+				out = writeRun(out);
+			}
+			it += n;
+			//The next element starts a new run
+			last_element = *it;
+			count = 1;
+			++it;
 		}
+		return out;
+	}
 
-		return encoded;
+
+	template<typename T>
+	template<typename OutputIterator>
+	OutputIterator Encoder<T>::finish(OutputIterator out)
+	{
+		if (count)
+			out = writeRun(out);
+		count = 0;
+		return out;
 	}
 
 
-	//Decompresses data which was compressed with RLE
-	template<typename Iterator>
-	std::vector<typename Iterator::value_type> decompress(Iterator begin, Iterator end)
+	template<typename T>
+	template<typename OutputIterator>
+	OutputIterator Encoder<T>::writeRun(OutputIterator out) const
 	{
-		static_assert(std::numeric_limits<typename Iterator::value_type>::is_integer, "Can only decompress Integer Datatypes!");
+		//Special case for only one occurance
+		if (count == 1 && !(utype(last_element) & MSB))
+			*out++ = last_element;
+		else {
+			*out++ = static_cast<T>(MSB | count);
+			*out++ = last_element;
+		}
+		return out;
+	}
 
-		//Some useful declarations
-		using stype = typename Iterator::value_type;
-		using utype = typename std::make_unsigned<stype>::type;	//Unsigned version of the iterator value type (Used for interpreting count variables)
-		const utype MSB = 1 << (std::numeric_limits<utype>::digits - 1);
-		const utype MAX_COUNT = std::numeric_limits<utype>::max() >> 1;
 
-		std::vector<stype> encoded;
 
+	//---------- Decoder Implementation ----------//
+
+	template<typename T>
+	template<typename Iterator, typename OutputIterator>
+	OutputIterator Decoder<T>::push(Iterator begin, Iterator end, OutputIterator out)
+	{
+		//Finish the run which the bounded push could not write completely
+		for (; remaining; --remaining)
+			*out++ = value;
+		for (Iterator it = begin; it != end; ++it) {
+			if (counter) {			//*it is the value belonging to the counter read before
+				for (utype i = 0; i < counter; ++i)
+					*out++ = *it;
+				counter = 0;
+			}
+			else if (utype(*it) & MSB)	//*it is a counter indicating how many times the next element should be repeated
+				counter = utype(*it) - MSB;
+			else					//The element can be inserted in the decompressed data as is
+				*out++ = *it;
+		}
+		return out;
+	}
+
+
+	template<typename T>
+	template<typename Iterator>
+	Iterator Decoder<T>::push(Iterator begin, Iterator end, T*& out, T* out_end)
+	{
 		Iterator it = begin;
-		while (it != end) {
-			if (*it & MSB) {		//*it is a counter indicating how many times the next element should be repeated
-				utype count = *it - MSB;
-				++it;
-				encoded.reserve(encoded.size() + count);
-				for (size_t i = 0; i < count; ++i)
-					encoded.push_back(*it);
+		while (true) {
+			//Continue the run which did not fit into the buffer before
+			while (remaining && out != out_end) {
+				*out++ = value;
+				--remaining;
+			}
+			if (remaining || it == end)
+				return it;
+			if (counter) {
+				value = *it;
+				remaining = counter;
+				counter = 0;
+			}
+			else if (utype(*it) & MSB)
+				counter = utype(*it) - MSB;
+			else {
+				value = *it;
+				remaining = 1;
 			}
-			else	//The element can be inserted in the decompressed vector as is
-				encoded.push_back(*it);
 			++it;
 		}
+	}
 
-		return encoded;
+
+	template<typename T>
+	bool Decoder<T>::pending() const
+	{
+		return remaining || counter;
 	}
 
 }
@@ -100,9 +517,253 @@ namespace RLE
 
 namespace Huffman
 {
+	// Indicates how the code is stored in front of the compressed data
+	//	TREE:      The whole huffman tree is stored
+	//	CANONICAL: Only the code lengths are stored and a canonical code is used
+	enum struct Header { TREE, CANONICAL };
+
+
 	// Contains everything the user has not to worry about
 	namespace detail
 	{
+		// Writes a stream of bits to a buffer of bytes, starting with the most significant bit of each byte.
+		// The bits are collected in a 64 bit accumulator and written to the buffer 32 bits at a time
+		class BitWriter
+		{
+		public:
+			inline explicit BitWriter(std::vector<uint8_t>& buffer) :
+				out(buffer)
+			{
+			}
+
+
+			// Appends the n (0 <= n <= 64) least significant bits of value, most significant bit first
+			inline void write(uint64_t value, int n)
+			{
+				if (n > 32) {
+					write(value >> 32, n - 32);
+					n = 32;
+				}
+				if (n == 0)
+					return;
+				accumulator |= (value & (uint64_t(-1) >> (64 - n))) << (64 - count - n);
+				count += n;
+				if (count >= 32) {
+					out.push_back(static_cast<uint8_t>(accumulator >> 56));
+					out.push_back(static_cast<uint8_t>(accumulator >> 48));
+					out.push_back(static_cast<uint8_t>(accumulator >> 40));
+					out.push_back(static_cast<uint8_t>(accumulator >> 32));
+					accumulator <<= 32;
+					count -= 32;
+				}
+			}
+
+
+			// Writes the remaining bits to the buffer, padding the last byte with zeros
+			inline void flush()
+			{
+				while (count > 0) {
+					out.push_back(static_cast<uint8_t>(accumulator >> 56));
+					accumulator <<= 8;
+					count -= 8;
+				}
+				count = 0;
+			}
+
+
+		private:
+			std::vector<uint8_t>& out;
+			uint64_t accumulator = 0;
+			int      count = 0;
+		};
+
+
+		// Reads a stream of bits from a buffer of bytes, starting with the most significant bit of each byte.
+		// Provides the same interface as BitReader
+		class ByteReader
+		{
+		public:
+			inline ByteReader(const uint8_t* data, size_t size) :
+				data(data),
+				size(size)
+			{
+				refill();
+			}
+
+
+			// Returns the next n bits (1 <= n <= 57) without consuming them.
+			// Bits past the end of the buffer are read as 0
+			inline uint64_t peek(int n) const
+			{
+				return window >> (64 - n);
+			}
+
+
+			// Skips the next n bits
+			inline void consume(int n)
+			{
+				window <<= n;
+				count -= n;
+				refill();
+			}
+
+
+			// Reads the next n (0 <= n <= 64) bits
+			inline uint64_t read(int n)
+			{
+				if (n > 32) {
+					const uint64_t high = read(n - 32);
+					return (high << 32) | read(32);
+				}
+				if (n == 0)
+					return 0;
+				const uint64_t value = peek(n);
+				consume(n);
+				return value;
+			}
+
+
+			// Returns true as long as there are bits left to read
+			inline bool available() const
+			{
+				return count > 0;
+			}
+
+
+		private:
+			const uint8_t* data;
+			size_t         size;
+			size_t         position = 0;
+			uint64_t       window = 0;
+			int            count = 0;
+
+
+			inline void refill()
+			{
+				while (count <= 56 && position < size) {
+					window |= static_cast<uint64_t>(data[position++]) << (56 - count);
+					count += 8;
+				}
+			}
+		};
+
+
+		// Appends the n least significant bits of value to bits, most significant bit first
+		inline void pushBits(std::vector<bool>& bits, uint64_t value, int n)
+		{
+			for (int bit = n - 1 ; bit >= 0 ; --bit)
+				bits.push_back((value >> bit) & 0x01);
+		}
+
+
+		// Appends the n least significant bits of value to the writer
+		inline void pushBits(BitWriter& writer, uint64_t value, int n)
+		{
+			writer.write(value, n);
+		}
+
+
+		// Appends the Elias gamma code of value (value >= 1) to bits.
+		// For a value with N+1 significant bits, N zeros are followed by the value itself
+		template<typename Sink>
+		inline void pushGamma(Sink& bits, uint64_t value)
+		{
+			int significant = 1;
+			while (significant < 64 && (value >> significant))
+				++significant;
+			pushBits(bits, 0, significant - 1);
+			pushBits(bits, value, significant);
+		}
+
+
+		// Reads n bits from the iterator, most significant bit first
+		template<typename Iterator>
+		inline uint64_t readBits(Iterator& it, int n)
+		{
+			uint64_t value = 0;
+			for (int i = 0 ; i < n ; ++i) {
+				value = (value << 1) | static_cast<uint64_t>(*it);
+				++it;
+			}
+			return value;
+		}
+
+
+		// Reads n bits from the reader
+		inline uint64_t readBits(ByteReader& reader, int n)
+		{
+			return reader.read(n);
+		}
+
+
+		// Reads an Elias gamma code from the iterator
+		template<typename Iterator>
+		inline uint64_t readGamma(Iterator& it)
+		{
+			int zeros = 0;
+			while (!readBits(it, 1))
+				++zeros;
+			return (uint64_t(1) << zeros) | readBits(it, zeros);
+		}
+
+
+		// Reads a stream of bits from an iterator over booleans.
+		// Up to 57 bits are buffered in a 64 bit window (most significant bit first),
+		// which allows looking at several bits at once
+		template<typename Iterator>
+		class BitReader
+		{
+		public:
+			inline BitReader(Iterator begin, Iterator end) :
+				current(begin),
+				last(end)
+			{
+				refill();
+			}
+
+
+			// Returns the next n bits (1 <= n <= 57) without consuming them.
+			// Bits past the end of the stream are read as 0
+			inline uint64_t peek(int n) const
+			{
+				return window >> (64 - n);
+			}
+
+
+			// Skips the next n bits
+			inline void consume(int n)
+			{
+				window <<= n;
+				count -= n;
+				refill();
+			}
+
+
+			// Returns true as long as there are bits left to read
+			inline bool available() const
+			{
+				return count > 0;
+			}
+
+
+		private:
+			Iterator current;
+			Iterator last;
+			uint64_t window = 0;
+			int      count = 0;
+
+
+			inline void refill()
+			{
+				while (count <= 56 && current != last) {
+					window |= static_cast<uint64_t>(*current) << (63 - count);
+					++count;
+					++current;
+				}
+			}
+		};
+
+
 		// A Huffman Tree implementation
 		template<typename WordT>
 		class HuffmanTree
@@ -233,8 +894,10 @@ namespace Huffman
 
 			// Copy constructor
 			inline HuffmanTree(const HuffmanTree<WordT>& other) :
-				root(other.root->clone()),
-				code(other.code)
+				root(other.root ? other.root->clone() : nullptr),
+				code(other.code),
+				decode_table(other.decode_table),
+				root_bits(other.root_bits)
 			{
 			}
 
@@ -256,8 +919,11 @@ namespace Huffman
 			// Copy assignment
 			inline HuffmanTree<WordT>& operator=(const HuffmanTree<WordT>& other)
 			{
-				root = other.root->clone();
+				if (root) delete root;
+				root = other.root ? other.root->clone() : nullptr;
 				code = other.code;
+				decode_table = other.decode_table;
+				root_bits = other.root_bits;
 				return *this;
 			}
 
@@ -270,14 +936,45 @@ namespace Huffman
 			}
 
 
-			// Creates a HuffmanTree from uncompressed data
+			// The longest codeword which can be stored
+			static constexpr uint8_t MAX_CODE_LENGTH = 64;
+
+
+			// Creates a HuffmanTree from uncompressed data.
+			// No codeword will be longer than max_length bits. If the huffman tree is too deep,
+			// the code lengths get limited and the tree is rebuilt from the resulting canonical code
 			template<typename Iterator>
-			inline static HuffmanTree<WordT> fromUncompressed(Iterator begin, Iterator end)
+			inline static HuffmanTree<WordT> fromUncompressed(Iterator begin, Iterator end, uint8_t max_length = MAX_CODE_LENGTH)
 			{
-				static_assert(std::is_same<typename Iterator::value_type, WordT>::value, "Iterator has wrong type");
+				static_assert(std::is_same<typename std::iterator_traits<Iterator>::value_type, WordT>::value, "Iterator has wrong type");
 				HuffmanTree<WordT> tree;
 				tree.makeTree(begin, end);
 				tree.makeCode();
+				if (tree.maxCodeLength() > max_length) {
+					std::vector<std::pair<WordT, uint8_t>> lengths;
+					lengths.reserve(tree.code.size());
+					for (const auto& p : tree.code)
+						lengths.push_back(std::make_pair(p.first, p.second.second));
+					limitLengths(lengths, max_length);
+					tree.makeCanonicalCode(lengths);
+					tree.makeTreeFromCode();
+				}
+				return tree;
+			}
+
+
+			// Creates a canonical code from uncompressed data.
+			// The code lengths are computed without allocating a tree,
+			// so only the code itself is available in the returned instance
+			// No codeword will be longer than max_length bits
+			template<typename Iterator>
+			inline static HuffmanTree<WordT> fromUncompressedCanonical(Iterator begin, Iterator end, uint8_t max_length = MAX_CODE_LENGTH)
+			{
+				static_assert(std::is_same<typename std::iterator_traits<Iterator>::value_type, WordT>::value, "Iterator has wrong type");
+				HuffmanTree<WordT> tree;
+				auto lengths = codeLengths(tree.makeFrequencyTable(begin, end));
+				limitLengths(lengths, max_length);
+				tree.makeCanonicalCode(lengths);
 				return tree;
 			}
 
@@ -291,6 +988,20 @@ namespace Huffman
 				HuffmanTree<WordT> tree;
 				begin = tree.reconstructTree(begin);
 				tree.makeCode();
+				tree.makeDecodeTable();
+				return std::make_pair(tree, begin);
+			}
+
+
+			// Reconstructs the canonical code stored in the memory pointed to by begin
+			// Returns a HuffmanTree instance without a tree and an iterator to the start of the actual data
+			template<typename Iterator>
+			inline static std::pair<HuffmanTree<WordT>, Iterator> fromCompressedCanonical(Iterator begin)
+			{
+				static_assert(std::is_same<typename Iterator::value_type, bool>::value, "Iterator must return bool");
+				HuffmanTree<WordT> tree;
+				begin = tree.reconstructCanonicalCode(begin);
+				tree.makeDecodeTable();
 				return std::make_pair(tree, begin);
 			}
 
@@ -299,7 +1010,7 @@ namespace Huffman
 			template<typename Iterator>
 			inline void makeTree(Iterator begin, Iterator end)
 			{
-				static_assert(std::is_same<typename Iterator::value_type, WordT>::value, "Iterator has wrong type");
+				static_assert(std::is_same<typename std::iterator_traits<Iterator>::value_type, WordT>::value, "Iterator has wrong type");
 				// Insert all words into a min-heap
 				auto freq_table = makeFrequencyTable(begin, end);
 				std::priority_queue<Node*, std::vector<Node*>, typename Node::NodePtrCmpGreater> heap;
@@ -328,29 +1039,120 @@ namespace Huffman
 			}
 
 
+			// Replaces the code with the canonical code for the given code lengths.
+			// Words are sorted by their code length and then by their value,
+			// each word getting the next free codeword of its length
+			inline void makeCanonicalCode(std::vector<std::pair<WordT, uint8_t>> lengths)
+			{
+				std::sort(lengths.begin(), lengths.end(), [](const std::pair<WordT, uint8_t>& a, const std::pair<WordT, uint8_t>& b) {
+					return a.second < b.second || (a.second == b.second && unsigned_word(a.first) < unsigned_word(b.first));
+				});
+				code.clear();
+				uint64_t next = 0;
+				uint8_t previous_length = lengths.front().second;
+				for (const auto& l : lengths) {
+					next <<= l.second - previous_length;
+					previous_length = l.second;
+					code.insert(std::make_pair(l.first, std::make_pair(next, l.second)));
+					++next;
+				}
+			}
+
+
+			// Rebuilds the tree from the code.
+			// The frequencies stored in the nodes are not restored
+			inline void makeTreeFromCode()
+			{
+				if (root) delete root;
+				root = new Node(0, 0);
+				for (const auto& p : code) {
+					Node* node = root;
+					for (int bit = p.second.second - 1 ; bit >= 0 ; --bit) {
+						Node*& child = (p.second.first >> bit) & 0x01 ? node->right : node->left;
+						if (!child)
+							child = new Node(0, 0);
+						node = child;
+					}
+					node->data = p.first;
+				}
+			}
+
+
+			// Returns the length of the longest codeword
+			inline uint8_t maxCodeLength() const
+			{
+				uint8_t max_length = 0;
+				for (const auto& p : code)
+					max_length = std::max(max_length, p.second.second);
+				return max_length;
+			}
+
+
+			// Reconstructs a canonical code from compressed data.
+			// Returns an iterator to the start of the actual compressed data
+			template<typename Iterator>
+			inline Iterator reconstructCanonicalCode(Iterator header)
+			{
+				static_assert(std::is_same<typename Iterator::value_type, bool>::value, "Iterator must return bool");
+				readCanonicalCode(header);
+				return header;
+			}
+
+
+			// Reconstructs a canonical code stored in the format of canonicalRepr from a reader
+			template<typename Reader>
+			inline void readCanonicalCode(Reader& header)
+			{
+				const uint64_t words = readGamma(header);
+				const int length_bits = bitWidth(readBits(header, 6));
+				std::vector<std::pair<WordT, uint8_t>> lengths;
+				lengths.reserve(words);
+				unsigned_word word = 0;
+				for (uint64_t i = 0 ; i < words ; ++i) {
+					if (i == 0)
+						word = static_cast<unsigned_word>(readBits(header, bits_per_word));
+					else
+						word += static_cast<unsigned_word>(readGamma(header));
+					lengths.push_back(std::make_pair(static_cast<WordT>(word), static_cast<uint8_t>(readBits(header, length_bits) + 1)));
+				}
+				makeCanonicalCode(lengths);
+			}
+
+
+			// Builds the lookup table used for decoding from the code.
+			// The root table is indexed by the next DECODE_TABLE_BITS bits of the
+			// input and resolves every code that is not longer than that at once.
+			// Longer codes point to subtables indexed by the bits following them.
+			inline void makeDecodeTable()
+			{
+				std::vector<CodeEntry> codes;
+				codes.reserve(code.size());
+				for (const auto& p : code)
+					codes.push_back(CodeEntry{ p.first, p.second.first, p.second.second });
+				decode_table.clear();
+				root_bits = makeDecodeTable(codes, 0).second;
+			}
+
+
 			// Reconstructs a tree from compressed data.
 			// Returns an iterator to the start of the actual compressed data
 			template<typename Iterator>
 			inline Iterator reconstructTree(Iterator tree)
 			{
 				static_assert(std::is_same<typename Iterator::value_type, bool>::value, "Iterator must return bool");
+				readTree(tree);
+				return tree;
+			}
+
+
+			// Reconstructs a tree stored in the format of treeRepr from a reader
+			template<typename Reader>
+			inline void readTree(Reader& reader)
+			{
 				// Cleanup
 				if (root) delete root;
 				// Reconstruct the tree
-				if (*tree) {
-					++tree;
-					root = new Node(0, 0);
-					for (int i = bits_per_word - 1 ; i >= 0 ; --i) {
-					root->data |= static_cast<WordT>(*tree) << i;
-					++tree;
-					}
-				}
-				else {
-					++tree;
-					root = new Node(0, 0);
-					tree = reconstructTree(root, tree);
-				}
-				return tree;
+				root = readNode(reader);
 			}
 
 
@@ -376,7 +1178,57 @@ namespace Huffman
 			// Get the representation of the tree used for storing it to file
 			inline std::vector<bool> treeRepr() const
 			{
-				return treeRepr(root);
+				std::vector<bool> res;
+				writeTree(res);
+				return res;
+			}
+
+
+			// Appends the representation of the tree to sink
+			template<typename Sink>
+			inline void writeTree(Sink& sink) const
+			{
+				writeNode(sink, root);
+			}
+
+
+			// Get the representation of the canonical code used for storing it to file.
+			// Only the words and their code lengths are stored:
+			//    - The number of words as an Elias gamma code
+			//    - The maximum code length minus one in 6 bits
+			//    - For each word in ascending order:
+			//        - The first word as is, afterwards the difference to the previous word as an Elias gamma code
+			//        - Its code length minus one, using as many bits as the maximum code length minus one needs
+			inline std::vector<bool> canonicalRepr() const
+			{
+				std::vector<bool> res;
+				writeCanonicalCode(res);
+				return res;
+			}
+
+
+			// Appends the representation of the canonical code to sink
+			template<typename Sink>
+			inline void writeCanonicalCode(Sink& sink) const
+			{
+				std::vector<std::pair<unsigned_word, uint8_t>> lengths;
+				lengths.reserve(code.size());
+				uint8_t max_length = 0;
+				for (const auto& p : code) {
+					lengths.push_back(std::make_pair(unsigned_word(p.first), p.second.second));
+					max_length = std::max(max_length, p.second.second);
+				}
+				std::sort(lengths.begin(), lengths.end());
+				const int length_bits = bitWidth(max_length - 1);
+				pushGamma(sink, lengths.size());
+				pushBits(sink, max_length - 1, 6);
+				for (size_t i = 0 ; i < lengths.size() ; ++i) {
+					if (i == 0)
+						pushBits(sink, lengths[i].first, bits_per_word);
+					else
+						pushGamma(sink, lengths[i].first - lengths[i - 1].first);
+					pushBits(sink, lengths[i].second - 1, length_bits);
+				}
 			}
 
 
@@ -404,25 +1256,260 @@ namespace Huffman
 			}
 
 
+			// Decodes the next word from the reader using the lookup table.
+			// makeDecodeTable has to be called before using this
+			template<typename Iterator>
+			inline WordT decode(BitReader<Iterator>& reader) const
+			{
+				return decodeWord(reader);
+			}
+
+
+			// Decodes the next word from the reader using the lookup table.
+			// makeDecodeTable has to be called before using this
+			inline WordT decode(ByteReader& reader) const
+			{
+				return decodeWord(reader);
+			}
+
+
 
 		private:
-			static constexpr int bits_per_word = std::numeric_limits<std::make_unsigned_t<WordT>>::digits;
+			template<typename Reader>
+			inline WordT decodeWord(Reader& reader) const
+			{
+				const DecodeEntry* table = decode_table.data();
+				uint8_t bits = root_bits;
+				while (true) {
+					const DecodeEntry& entry = table[reader.peek(bits)];
+					if (entry.length) {
+						reader.consume(entry.length);
+						return entry.word;
+					}
+					// An entry which was never filled (e.g. the unused half of a tree with a single word)
+					// does not belong to any code, so the data is corrupt
+					if (!entry.bits) {
+						assert(false && "The data contains a code which is not part of the tree");
+						reader.consume(bits);
+						return WordT();
+					}
+					// The code is longer than this table, continue in the subtable
+					reader.consume(bits);
+					table = decode_table.data() + entry.next;
+					bits = entry.bits;
+				}
+			}
+
+
+			// A codeword together with the word it encodes
+			struct CodeEntry
+			{
+				WordT    word;
+				uint64_t code;
+				uint8_t  length;
+			};
+
+			// An entry of the decoding lookup table.
+			// If length is nonzero, the entry decodes to word and length bits are consumed.
+			// Otherwise the code continues in the subtable starting at next,
+			// which is indexed by the following bits bits.
+			struct DecodeEntry
+			{
+				WordT    word;
+				uint8_t  length;
+				uint8_t  bits;
+				uint32_t next;
+			};
+
+			using unsigned_word = std::make_unsigned_t<WordT>;
+			// Pairs of words and how often they occur
+			using FrequencyTable = std::vector<std::pair<WordT, uint64_t>>;
+			static constexpr int bits_per_word = std::numeric_limits<unsigned_word>::digits;
+			// The maximum number of bits looked up at once while decoding
+			static constexpr uint8_t DECODE_TABLE_BITS = 11;
 			Node* root = nullptr;
 			// The code map maps a word to a pair containing the code word and its length
 			std::unordered_map<WordT, std::pair<uint64_t, uint8_t>> code;
+			// All decoding tables stored one after the other. The root table starts at index 0
+			std::vector<DecodeEntry> decode_table;
+			uint8_t root_bits = 0;
 
 
 			template<typename Iterator>
-			inline std::map<WordT, uint64_t> makeFrequencyTable(Iterator begin, Iterator end) const
+			inline FrequencyTable makeFrequencyTable(Iterator begin, Iterator end) const
 			{
-				static_assert(std::is_same<typename Iterator::value_type, WordT>::value,
+				static_assert(std::is_same<typename std::iterator_traits<Iterator>::value_type, WordT>::value,
 						  "Iterator has wrong type");
+				return makeFrequencyTable(begin, end, std::integral_constant<bool, (bits_per_word <= 16)>());
+			}
+
+
+			// Counts the words in an array with one counter per possible word.
+			// Consecutive words are counted in different sub-histograms (lanes), so runs of
+			// the same word do not have to wait for the previous increment of their counter.
+			// The counters are reused by every call on the same thread and are zero between calls:
+			// They are cleared while being added up at the end, and only folded into 64 bit totals
+			// if they could overflow before the end.
+			// Short inputs are sorted instead, as reading all counters would cost more than counting them
+			template<typename Iterator>
+			inline FrequencyTable makeFrequencyTable(Iterator begin, Iterator end, std::true_type) const
+			{
+				constexpr size_t words = size_t(1) << bits_per_word;
+				constexpr size_t lanes = bits_per_word <= 8 ? 4 : 2;
+				constexpr uint64_t max_chunk = uint64_t(0xFFFFFFFF);
+				FrequencyTable table;
+				if ((size_t)std::distance(begin, end) < words / 16) {
+					std::vector<unsigned_word> sorted(begin, end);
+					std::sort(sorted.begin(), sorted.end());
+					for (size_t i = 0 ; i < sorted.size() ; ) {
+						size_t j = i + 1;
+						while (j < sorted.size() && sorted[j] == sorted[i])
+							++j;
+						table.push_back(std::make_pair(static_cast<WordT>(sorted[i]), uint64_t(j - i)));
+						i = j;
+					}
+					return table;
+				}
+				std::vector<uint32_t>& counts = frequencyCounters();
+				std::vector<uint64_t> totals;
+				for (Iterator it = begin ; ; ) {
+					for (uint64_t n = 0 ; it != end && n < max_chunk ; ++it, ++n)
+						++counts[(n % lanes) * words + unsigned_word(*it)];
+					if (it == end)
+						break;
+					totals.resize(words, 0);
+					for (size_t lane = 0 ; lane < lanes ; ++lane)
+						for (size_t word = 0 ; word < words ; ++word) {
+							totals[word] += counts[lane * words + word];
+							counts[lane * words + word] = 0;
+						}
+				}
+				for (size_t word = 0 ; word < words ; ++word) {
+					uint64_t total = totals.empty() ? 0 : totals[word];
+					for (size_t lane = 0 ; lane < lanes ; ++lane) {
+						total += counts[lane * words + word];
+						counts[lane * words + word] = 0;
+					}
+					if (total)
+						table.push_back(std::make_pair(static_cast<WordT>(word), total));
+				}
+				return table;
+			}
+
+
+			// The lane counters of makeFrequencyTable for the calling thread
+			inline static std::vector<uint32_t>& frequencyCounters()
+			{
+				constexpr size_t lanes = bits_per_word <= 8 ? 4 : 2;
+				thread_local std::vector<uint32_t> counts(lanes * (size_t(1) << bits_per_word), 0);
+				return counts;
+			}
+
+
+			// Counts the words in a map, as an array would get too large for them
+			template<typename Iterator>
+			inline FrequencyTable makeFrequencyTable(Iterator begin, Iterator end, std::false_type) const
+			{
 				std::map<WordT, uint64_t> table;
 				for (Iterator it = begin ; it != end ; ++it) {
 					auto elem_iter = table.insert(std::make_pair(*it, 0)).first;
 					elem_iter->second += 1;
 				}
-				return table;
+				return FrequencyTable(table.begin(), table.end());
+			}
+
+
+			// Computes the code lengths of an optimal prefix code for the given frequencies.
+			// The words get merged like in makeTree, but as the merged nodes are created
+			// in ascending order of their frequency, two sorted queues replace the heap
+			// and only the parent of each node has to be stored.
+			// Leaves get the indices 0 to n-1, merged nodes the indices n to 2n-2
+			inline static std::vector<std::pair<WordT, uint8_t>> codeLengths(const FrequencyTable& freq_table)
+			{
+				std::vector<std::pair<uint64_t, WordT>> leaves;
+				leaves.reserve(freq_table.size());
+				for (const auto& p : freq_table)
+					leaves.push_back(std::make_pair(p.second, p.first));
+				std::sort(leaves.begin(), leaves.end());
+				const size_t n = leaves.size();
+				if (n == 1)
+					return { std::make_pair(leaves[0].second, uint8_t(1)) };
+				std::vector<uint64_t> merged(n - 1);
+				std::vector<size_t> parent(2 * n - 1);
+				size_t next_leaf = 0;
+				size_t next_merged = 0;
+				for (size_t m = 0 ; m < n - 1 ; ++m) {
+					uint64_t frequency = 0;
+					for (int child = 0 ; child < 2 ; ++child) {
+						if (next_leaf < n && (next_merged == m || leaves[next_leaf].first <= merged[next_merged])) {
+							frequency += leaves[next_leaf].first;
+							parent[next_leaf++] = n + m;
+						}
+						else {
+							frequency += merged[next_merged];
+							parent[n + next_merged++] = n + m;
+						}
+					}
+					merged[m] = frequency;
+				}
+				// Parents always have a higher index than their children
+				std::vector<int> depth(2 * n - 1, 0);
+				for (size_t i = 2 * n - 2 ; i-- > 0 ; )
+					depth[i] = depth[parent[i]] + 1;
+				std::vector<std::pair<WordT, uint8_t>> lengths(n);
+				for (size_t i = 0 ; i < n ; ++i)
+					lengths[i] = std::make_pair(leaves[i].second, static_cast<uint8_t>(depth[i]));
+				return lengths;
+			}
+
+
+			// Limits the code lengths to max_length bits while keeping a complete prefix code.
+			// As long as there are codes longer than max_length, two words of the longest length
+			// are removed. One of them moves up a level, while the other one takes the place of a
+			// word of a shorter length, which in turn moves down a level (JPEG, Annex K.3).
+			// Afterwards, the words get the new lengths in the order of their old lengths
+			inline static void limitLengths(std::vector<std::pair<WordT, uint8_t>>& lengths, uint8_t max_length)
+			{
+				assert(max_length >= 1 && max_length <= MAX_CODE_LENGTH);
+				assert(max_length == MAX_CODE_LENGTH || lengths.size() <= (uint64_t(1) << max_length));
+				uint8_t longest = 0;
+				for (const auto& l : lengths)
+					longest = std::max(longest, l.second);
+				if (longest <= max_length)
+					return;
+				// Count how many words there are of each length
+				std::vector<uint64_t> count(longest + 1, 0);
+				for (const auto& l : lengths)
+					++count[l.second];
+				for (int i = longest ; i > max_length ; --i) {
+					while (count[i] > 0) {
+						int j = i - 2;
+						while (count[j] == 0)
+							--j;
+						count[i] -= 2;
+						count[i - 1] += 1;
+						count[j + 1] += 2;
+						count[j] -= 1;
+					}
+				}
+				// Distribute the new lengths
+				std::sort(lengths.begin(), lengths.end(), [](const std::pair<WordT, uint8_t>& a, const std::pair<WordT, uint8_t>& b) {
+					return a.second < b.second || (a.second == b.second && unsigned_word(a.first) < unsigned_word(b.first));
+				});
+				size_t next = 0;
+				for (int length = 1 ; length <= max_length ; ++length)
+					for (uint64_t i = 0 ; i < count[length] ; ++i)
+						lengths[next++].second = static_cast<uint8_t>(length);
+			}
+
+
+			// Returns the number of bits needed to represent n
+			inline static int bitWidth(uint64_t n)
+			{
+				int width = 0;
+				while (width < 64 && (n >> width))
+					++width;
+				return width;
 			}
 
 
@@ -438,41 +1525,51 @@ namespace Huffman
 			}
 
 
-			// Reconstructs a partial tree from the given data
-			// Returns an iterator to the bit after the space used to store the tree
-			template<typename Iterator>
-			inline Iterator reconstructTree(Node* node, Iterator tree)
+			// Builds a decoding table for the given codes, of which the first consumed bits
+			// have already been resolved by the parent tables.
+			// Returns the index of the table and the number of bits it is indexed by
+			inline std::pair<uint32_t, uint8_t> makeDecodeTable(const std::vector<CodeEntry>& codes, uint8_t consumed)
 			{
-				static_assert(std::is_same<typename Iterator::value_type, bool>::value, "Iterator must return bool");
-				// Left tree
-				if (*tree) {
-					++tree;
-					node->left = new Node(0, 0);
-					for (int i = bits_per_word - 1 ; i >= 0 ; --i) {
-					node->left->data |= static_cast<WordT>(*tree) << i;
-					++tree;
-					}
-				}
-				else {
-					++tree;
-					node->left = new Node(0, 0);
-					tree = reconstructTree(node->left, tree);
-				}
-				// Right tree
-				if (*tree) {
-					++tree;
-					node->right = new Node(0, 0);
-					for (int i = bits_per_word - 1 ; i >= 0 ; --i) {
-					node->right->data |= static_cast<WordT>(*tree) << i;
-					++tree;
+				uint8_t max_length = 0;
+				for (const CodeEntry& c : codes)
+					max_length = std::max(max_length, c.length);
+				const uint8_t bits = std::min<uint8_t>(max_length - consumed, DECODE_TABLE_BITS);
+				const uint32_t offset = static_cast<uint32_t>(decode_table.size());
+				decode_table.resize(offset + (size_t(1) << bits), DecodeEntry{ WordT(), 0, 0, 0 });
+				// Codes which do not fit into this table, grouped by their index in it
+				std::map<uint64_t, std::vector<CodeEntry>> overflow;
+				for (const CodeEntry& c : codes) {
+					const uint8_t remaining = c.length - consumed;
+					const uint64_t rest = remaining < 64 ? c.code & ((uint64_t(1) << remaining) - 1) : c.code;
+					if (remaining <= bits) {
+						// Every index starting with this code decodes to its word
+						const uint64_t first = rest << (bits - remaining);
+						for (uint64_t i = 0 ; i < (uint64_t(1) << (bits - remaining)) ; ++i)
+							decode_table[offset + first + i] = DecodeEntry{ c.word, remaining, 0, 0 };
 					}
+					else
+						overflow[rest >> (remaining - bits)].push_back(c);
 				}
-				else {
-					++tree;
-					node->right = new Node(0, 0);
-					tree = reconstructTree(node->right, tree);
+				for (const auto& p : overflow) {
+					auto subtable = makeDecodeTable(p.second, consumed + bits);
+					decode_table[offset + p.first] = DecodeEntry{ WordT(), 0, subtable.second, subtable.first };
 				}
-				return tree;
+				return std::make_pair(offset, bits);
+			}
+
+
+			// Reconstructs a partial tree from the given reader
+			template<typename Reader>
+			inline Node* readNode(Reader& reader)
+			{
+				// Leaf
+				if (readBits(reader, 1))
+					return new Node(0, static_cast<WordT>(readBits(reader, bits_per_word)));
+				// Branch
+				Node* node = new Node(0, 0);
+				node->left = readNode(reader);
+				node->right = readNode(reader);
+				return node;
 			}
 
 
@@ -492,19 +1589,16 @@ namespace Huffman
 			}
 
 
-			inline std::vector<bool> treeRepr(const Node* node) const
+			template<typename Sink>
+			inline void writeNode(Sink& sink, const Node* node) const
 			{
-				std::vector<bool> res(1, node->isLeaf());
+				pushBits(sink, node->isLeaf(), 1);
 				if (node->isLeaf())
-					for (int bit = bits_per_word-1 ; bit >= 0 ; --bit)
-					res.push_back((node->data >> bit) & WordT(1));
+					pushBits(sink, unsigned_word(node->data), bits_per_word);
 				else {
-					for (const auto& bit : treeRepr(node->left))
-					res.push_back(bit);
-					for (const auto& bit : treeRepr(node->right))
-					res.push_back(bit);
+					writeNode(sink, node->left);
+					writeNode(sink, node->right);
 				}
-				return res;
 			}
 
 
@@ -512,8 +1606,53 @@ namespace Huffman
 			{
 				std::swap(root, other.root);
 				std::swap(code, other.code);
+				std::swap(decode_table, other.decode_table);
+				std::swap(root_bits, other.root_bits);
 			}
 		};
+
+
+		// Decodes count words stored in the format of compress(data, size, header),
+		// starting after the word count, to out
+		template<typename WordT>
+		inline void decodeWords(ByteReader& reader, Header header, WordT* out, uint64_t count)
+		{
+			if (count == 0)
+				return;
+			// Reconstruct the huffman code
+			HuffmanTree<WordT> huffman_tree;
+			if (header == Header::TREE) {
+				huffman_tree.readTree(reader);
+				huffman_tree.makeCode();
+			}
+			else
+				huffman_tree.readCanonicalCode(reader);
+			huffman_tree.makeDecodeTable();
+			for (uint64_t i = 0 ; i < count ; ++i)
+				out[i] = huffman_tree.decode(reader);
+		}
+
+
+		// Calls f(i) for every i in [0, count) using up to threads threads (0: one per core).
+		// The indices are handed out one at a time, so uneven work is balanced automatically
+		template<typename F>
+		inline void parallelFor(size_t count, unsigned threads, F f)
+		{
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+			std::atomic<size_t> next(0);
+			auto work = [&]() {
+				for (size_t i = next++ ; i < count ; i = next++)
+					f(i);
+			};
+			std::vector<std::thread> workers;
+			for (unsigned t = 1 ; t < threads ; ++t)
+				workers.emplace_back(work);
+			work();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
 	}
 	
 	
@@ -540,42 +1679,363 @@ namespace Huffman
 	//    A -> 0
 	//    B -> 10
 	//    C -> 11
+	// With header == Header::CANONICAL, a canonical code is used instead
+	// and only the code length of each word is stored in the first part
+	// (see HuffmanTree::canonicalRepr). The decoder rebuilds the code
+	// from the lengths without reconstructing a tree.
+	// No codeword gets longer than max_length (1 to 64) bits. Limiting the
+	// length worsens the compression ratio slightly, but speeds up decoding.
 	template<typename Iterator>
-	inline std::vector<bool> compress(Iterator begin, Iterator end)
+	inline std::vector<bool> compress(Iterator begin, Iterator end, Header header = Header::TREE,
+	                                  uint8_t max_length = detail::HuffmanTree<typename std::iterator_traits<Iterator>::value_type>::MAX_CODE_LENGTH)
 	{
 		// The word type is inferred from the iterator type
 		using word_type = typename Iterator::value_type;
 		// The word type has to be an integral value
 		static_assert(std::numeric_limits<word_type>::is_integer, "The type to compress must be an integral type");
 		// Build a huffman tree of the data
-		auto huffman_tree = detail::HuffmanTree<word_type>::fromUncompressed(begin, end);
+		auto huffman_tree = header == Header::TREE ? detail::HuffmanTree<word_type>::fromUncompressed(begin, end, max_length)
+		                                           : detail::HuffmanTree<word_type>::fromUncompressedCanonical(begin, end, max_length);
 		// Store the compressed data inside a vector of booleans
-		std::vector<bool> compressed(huffman_tree.treeRepr());  // Store the huffman tree itself
+		std::vector<bool> compressed(header == Header::TREE ? huffman_tree.treeRepr() : huffman_tree.canonicalRepr());  // Store the code itself
 		for (Iterator it = begin ; it != end ; ++it) {
 		auto code = huffman_tree.encode(*it);
-		for (int bit = code.second - 1 ; bit >= 0 ; --bit)
-			compressed.push_back((code.first >> bit) & 0x01);
+		detail::pushBits(compressed, code.first, code.second);
+		}
+		return compressed;
+	}
+
+
+	// Compresses size words starting at data to a buffer of bytes.
+	// The buffer starts with the number of words as a 64 bit integer,
+	// followed by the same bits as written by compress(begin, end, header).
+	// The last byte is padded with zeros.
+	// No codeword gets longer than max_length (1 to 64) bits.
+	template<typename WordT>
+	inline std::vector<uint8_t> compress(const WordT* data, size_t size, Header header = Header::TREE,
+	                                     uint8_t max_length = detail::HuffmanTree<WordT>::MAX_CODE_LENGTH)
+	{
+		static_assert(std::numeric_limits<WordT>::is_integer, "The type to compress must be an integral type");
+		std::vector<uint8_t> compressed;
+		detail::BitWriter writer(compressed);
+		writer.write(size, 64);
+		if (size > 0) {
+			// Build a huffman tree of the data and store the code itself
+			auto huffman_tree = header == Header::TREE ? detail::HuffmanTree<WordT>::fromUncompressed(data, data + size, max_length)
+			                                           : detail::HuffmanTree<WordT>::fromUncompressedCanonical(data, data + size, max_length);
+			if (header == Header::TREE)
+				huffman_tree.writeTree(writer);
+			else
+				huffman_tree.writeCanonicalCode(writer);
+			for (size_t i = 0 ; i < size ; ++i) {
+				auto code = huffman_tree.encode(data[i]);
+				writer.write(code.first, code.second);
+			}
 		}
+		writer.flush();
 		return compressed;
 	}
 
 
-	// Decompresses the given data to a vector of WordTs
+	// Decompresses the given data to a vector of WordTs.
+	// header has to match the header used for compressing the data.
+	// The words are decoded with a lookup table built from the code,
+	// which resolves up to 11 bits per lookup instead of walking the tree bit by bit
 	template<typename WordT, typename Iterator>
-	inline std::vector<WordT> decompress(Iterator begin, Iterator end)
+	inline std::vector<WordT> decompress(Iterator begin, Iterator end, Header header = Header::TREE)
 	{
 		static_assert(std::is_same<typename Iterator::value_type, bool>::value, "Iterator must return bool");
-		// Reconstruct the huffman tree
-		auto res = detail::HuffmanTree<WordT>::fromCompressed(begin);
-		auto huffman_tree = res.first;
-		begin = res.second;
+		// Reconstruct the huffman code
+		auto res = header == Header::TREE ? detail::HuffmanTree<WordT>::fromCompressed(begin)
+		                                  : detail::HuffmanTree<WordT>::fromCompressedCanonical(begin);
+		const auto& huffman_tree = res.first;
+		detail::BitReader<Iterator> reader(res.second, end);
 		// Store the decompressed data inside a vector of WordTs
 		std::vector<WordT> decompressed;
-		while (begin != end) {
-		auto res = huffman_tree.decode(begin);
-		decompressed.push_back(res.first);
-		begin = res.second;
+		while (reader.available())
+			decompressed.push_back(huffman_tree.decode(reader));
+		return decompressed;
+	}
+
+
+	// Decompresses a buffer of bytes created by compress(data, size, header) to a vector of WordTs.
+	// header has to match the header used for compressing the data
+	template<typename WordT>
+	inline std::vector<WordT> decompress(const uint8_t* data, size_t size, Header header = Header::TREE)
+	{
+		detail::ByteReader reader(data, size);
+		std::vector<WordT> decompressed(reader.read(64));
+		detail::decodeWords(reader, header, decompressed.data(), decompressed.size());
+		return decompressed;
+	}
+
+
+	// Compresses size words starting at data in independent blocks of block_size words.
+	// The blocks are compressed concurrently on up to threads threads (0: one per core),
+	// each of them with its own code. The buffer consists of:
+	//    - The total number of words as a 64 bit integer
+	//    - The block size as a 64 bit integer
+	//    - The number of blocks as a 64 bit integer
+	//    - The index: The size in bytes of each compressed block as a 64 bit integer
+	//    - The blocks, each of them in the format of compress(data, size, header)
+	// As every block can be found through the index, decompressBlocks decodes them in parallel as well.
+	template<typename WordT>
+	inline std::vector<uint8_t> compressBlocks(const WordT* data, size_t size, size_t block_size = 262144 / sizeof(WordT),
+	                                           unsigned threads = 0, Header header = Header::TREE,
+	                                           uint8_t max_length = detail::HuffmanTree<WordT>::MAX_CODE_LENGTH)
+	{
+		static_assert(std::numeric_limits<WordT>::is_integer, "The type to compress must be an integral type");
+		assert(block_size > 0);
+		const size_t block_count = (size + block_size - 1) / block_size;
+		std::vector<std::vector<uint8_t>> blocks(block_count);
+		detail::parallelFor(block_count, threads, [&](size_t i) {
+			const size_t first = i * block_size;
+			blocks[i] = compress(data + first, std::min(block_size, size - first), header, max_length);
+		});
+		// Write the header and the index, followed by the blocks
+		std::vector<uint8_t> compressed;
+		detail::BitWriter writer(compressed);
+		writer.write(size, 64);
+		writer.write(block_size, 64);
+		writer.write(block_count, 64);
+		size_t total = 0;
+		for (const auto& block : blocks) {
+			writer.write(block.size(), 64);
+			total += block.size();
 		}
+		writer.flush();
+		compressed.reserve(compressed.size() + total);
+		for (const auto& block : blocks)
+			compressed.insert(compressed.end(), block.begin(), block.end());
+		return compressed;
+	}
+
+
+	// Decompresses a buffer of bytes created by compressBlocks to a vector of WordTs.
+	// The blocks are decoded concurrently on up to threads threads (0: one per core) directly into the result.
+	// header has to match the header used for compressing the data
+	template<typename WordT>
+	inline std::vector<WordT> decompressBlocks(const uint8_t* data, size_t size, unsigned threads = 0, Header header = Header::TREE)
+	{
+		detail::ByteReader reader(data, size);
+		std::vector<WordT> decompressed(reader.read(64));
+		const uint64_t block_size = reader.read(64);
+		const uint64_t block_count = reader.read(64);
+		// Find the start of every block
+		std::vector<size_t> offsets(block_count + 1);
+		offsets[0] = 3 * 8 + block_count * 8;
+		for (uint64_t i = 0 ; i < block_count ; ++i)
+			offsets[i + 1] = offsets[i] + reader.read(64);
+		assert(offsets[block_count] <= size);
+		detail::parallelFor(block_count, threads, [&](size_t i) {
+			detail::ByteReader block(data + offsets[i], offsets[i + 1] - offsets[i]);
+			const uint64_t count = block.read(64);
+			assert(i * block_size + count <= decompressed.size());
+			detail::decodeWords(block, header, decompressed.data() + i * block_size, count);
+		});
+		return decompressed;
+	}
+}
+
+
+
+// Chains the compression algorithms above, e.g. RLE followed by Huffman coding.
+// The data is processed in chunks: Every stage writes its output for a chunk into a buffer
+// which is reused for all chunks and read by the next stage, so no intermediate result
+// of the size of the whole data is ever allocated.
+namespace Pipeline
+{
+	// The stages a pipeline can be built of
+	enum struct Stage : uint8_t
+	{
+		RLE = 1,				// Run length encoding, has to be the first stage
+		HUFFMAN = 2,			// Huffman coding with Huffman::Header::TREE, has to be the last stage
+		HUFFMAN_CANONICAL = 3	// Huffman coding with Huffman::Header::CANONICAL, has to be the last stage
+	};
+
+
+	namespace detail
+	{
+		// Which stages are applied in a pipeline
+		struct Configuration
+		{
+			bool rle = false;
+			bool huffman = false;
+			Huffman::Header header = Huffman::Header::TREE;
+		};
+
+
+		// Checks the order of the stages and returns which of them are applied
+		inline Configuration configure(const std::vector<Stage>& stages)
+		{
+			Configuration config;
+			for (size_t i = 0 ; i < stages.size() ; ++i) {
+				switch (stages[i]) {
+				case Stage::RLE:
+					assert(i == 0 && "RLE has to be the first stage");
+					config.rle = true;
+					break;
+				case Stage::HUFFMAN:
+				case Stage::HUFFMAN_CANONICAL:
+					assert(i + 1 == stages.size() && "Huffman coding has to be the last stage");
+					config.huffman = true;
+					config.header = stages[i] == Stage::HUFFMAN ? Huffman::Header::TREE : Huffman::Header::CANONICAL;
+					break;
+				default:
+					assert(false && "Unknown stage");
+				}
+			}
+			return config;
+		}
+
+
+		// Appends the bytes least significant bytes of value, most significant byte first
+		inline void putInteger(std::vector<uint8_t>& out, uint64_t value, int bytes)
+		{
+			for (int i = bytes - 1 ; i >= 0 ; --i)
+				out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+
+
+		// Reads an integer of the given number of bytes written by putInteger and advances it past it
+		inline uint64_t getInteger(const uint8_t*& it, int bytes)
+		{
+			uint64_t value = 0;
+			for (int i = 0 ; i < bytes ; ++i)
+				value = (value << 8) | *it++;
+			return value;
+		}
+
+
+		// Runs the last stage on the output of the previous ones and appends the result as a chunk
+		template<typename WordT>
+		inline void writeChunk(std::vector<uint8_t>& out, const WordT* data, size_t size, const Configuration& config, uint8_t max_length)
+		{
+			if (size == 0)	// A chunk of length 0 marks the end of the data
+				return;
+			if (config.huffman) {
+				const std::vector<uint8_t> bytes = Huffman::compress(data, size, config.header, max_length);
+				assert(bytes.size() <= std::numeric_limits<uint32_t>::max());
+				putInteger(out, bytes.size(), 4);
+				out.insert(out.end(), bytes.begin(), bytes.end());
+			}
+			else {
+				const size_t bytes = size * sizeof(WordT);
+				assert(bytes <= std::numeric_limits<uint32_t>::max());
+				putInteger(out, bytes, 4);
+				out.resize(out.size() + bytes);
+				std::memcpy(out.data() + out.size() - bytes, data, bytes);
+			}
+		}
+	}
+
+
+	// Compresses size words starting at data by applying the stages one after the other.
+	// The words are passed through the pipeline in chunks of chunk_size words.
+	// The buffer consists of:
+	//    - sizeof(WordT) as an 8 bit integer
+	//    - The number of stages as an 8 bit integer, followed by the id of every stage as an 8 bit integer
+	//    - The total number of words as a 64 bit integer
+	//    - The chunks, each of them as its size in bytes as a 32 bit integer followed by the output of the last stage.
+	//      Huffman coded chunks are in the format of Huffman::compress(data, size, header),
+	//      otherwise the chunk contains the words in native byte order.
+	//    - A chunk of size 0
+	// The integers in the frame are stored most significant byte first.
+	// RLE runs can span multiple chunks, as the state of the encoder is carried over from one chunk to the next.
+	template<typename WordT>
+	inline std::vector<uint8_t> compress(const WordT* data, size_t size, const std::vector<Stage>& stages,
+	                                     size_t chunk_size = 65536, uint8_t max_length = Huffman::detail::HuffmanTree<WordT>::MAX_CODE_LENGTH)
+	{
+		static_assert(std::numeric_limits<WordT>::is_integer, "The type to compress must be an integral type");
+		assert(chunk_size > 0);
+		assert(stages.size() <= std::numeric_limits<uint8_t>::max());
+		const detail::Configuration config = detail::configure(stages);
+		// Write the header of the frame
+		std::vector<uint8_t> compressed;
+		detail::putInteger(compressed, sizeof(WordT), 1);
+		detail::putInteger(compressed, stages.size(), 1);
+		for (Stage stage : stages)
+			detail::putInteger(compressed, static_cast<uint8_t>(stage), 1);
+		detail::putInteger(compressed, size, 8);
+		// Pass the data through the stages chunk by chunk
+		RLE::Encoder<WordT> encoder;
+		std::vector<WordT> buffer;	// Output of the RLE stage, a chunk is encoded to at most 2 * chunk_size + 2 words
+		if (config.rle)
+			buffer.reserve(2 * chunk_size + 2);
+		for (size_t first = 0 ; first < size ; first += chunk_size) {
+			const size_t count = std::min(chunk_size, size - first);
+			if (config.rle) {
+				buffer.clear();
+				auto out = encoder.push(data + first, data + first + count, std::back_inserter(buffer));
+				if (first + count == size)
+					encoder.finish(out);
+				detail::writeChunk(compressed, buffer.data(), buffer.size(), config, max_length);
+			}
+			else
+				detail::writeChunk(compressed, data + first, count, config, max_length);
+		}
+		detail::putInteger(compressed, 0, 4);
+		return compressed;
+	}
+
+
+	// Decompresses a buffer of bytes created by compress(data, size, stages) to a vector of WordTs.
+	// The stages are read from the frame and undone in reverse order, chunk by chunk
+	template<typename WordT>
+	inline std::vector<WordT> decompress(const uint8_t* data, size_t size)
+	{
+		static_assert(std::numeric_limits<WordT>::is_integer, "The type to decompress must be an integral type");
+		const uint8_t* it = data;
+		// Read the header of the frame
+		const uint64_t word_size = detail::getInteger(it, 1);
+		assert(word_size == sizeof(WordT) && "The data was compressed with a different word type");
+		(void)word_size;
+		std::vector<Stage> stages(detail::getInteger(it, 1));
+		for (Stage& stage : stages)
+			stage = static_cast<Stage>(detail::getInteger(it, 1));
+		const detail::Configuration config = detail::configure(stages);
+		std::vector<WordT> decompressed(detail::getInteger(it, 8));
+		WordT* out = decompressed.data();
+		WordT* const out_end = out + decompressed.size();
+		// Undo the stages chunk by chunk
+		RLE::Decoder<WordT> decoder;
+		std::vector<WordT> buffer;	// Input of the RLE stage
+		while (true) {
+			assert(it + 4 <= data + size);
+			const uint32_t length = static_cast<uint32_t>(detail::getInteger(it, 4));
+			if (length == 0)
+				break;
+			assert(it + length <= data + size);
+			if (config.huffman) {
+				Huffman::detail::ByteReader reader(it, length);
+				const uint64_t count = reader.read(64);
+				if (config.rle) {
+					buffer.resize(count);
+					Huffman::detail::decodeWords(reader, config.header, buffer.data(), count);
+				}
+				else {
+					assert(out + count <= out_end);
+					Huffman::detail::decodeWords(reader, config.header, out, count);
+					out += count;
+				}
+			}
+			else if (config.rle) {
+				buffer.resize(length / sizeof(WordT));
+				std::memcpy(buffer.data(), it, length);
+			}
+			else {
+				assert(out + length / sizeof(WordT) <= out_end);
+				std::memcpy(out, it, length);
+				out += length / sizeof(WordT);
+			}
+			if (config.rle) {
+				auto consumed = decoder.push(buffer.cbegin(), buffer.cend(), out, out_end);
+				assert(consumed == buffer.cend() && "The data decodes to more words than stored in the header");
+				(void)consumed;
+			}
+			it += length;
+		}
+		assert(out == out_end && !decoder.pending() && "The data decodes to fewer words than stored in the header");
 		return decompressed;
 	}
-}
\ No newline at end of file
+}
@@ -1,86 +1,78 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include <iostream>
 
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 
 
 
+
+namespace gf256_detail
+{
+	struct LogTables
+	{
+		uint8_t log[0x100];
+		uint8_t exp[0x200];
+	};
+
+
+	//Computes the powers of the generator x + 1 and their logarithms
+	constexpr LogTables make_log_tables()
+	{
+		LogTables tables{};
+		uint8_t x = 1;
+		for (int i = 0; i < 0xFF; ++i) {
+			tables.exp[i] = x;
+			tables.log[x] = uint8_t(i);
+			//Multiply by x + 1 and reduce modulo x^8 + x^4 + x^3 + x + 1
+			x = uint8_t(x ^ (x << 1) ^ (x & 0x80 ? 0x1B : 0x00));
+		}
+		//log(1) is stored as 0xFF instead of 0, as in the original table
+		tables.log[1] = 0xFF;
+		//The second half repeats the first one, so the sum of two logarithms (at most 0xFF + 0xFE) never has to be reduced modulo 0xFF
+		for (int i = 0xFF; i < 0x200; ++i)
+			tables.exp[i] = tables.exp[i - 0xFF];
+		return tables;
+	}
+
+
+	inline constexpr LogTables LOG_TABLES = make_log_tables();
+}
+
+
 //Multiplication is performed using this logarithm table to the base x + 1
 //log(0) is in this case defined to be 0
-static const uint8_t LOG[0x100] = { 0x00, 0xFF, 0x19, 0x01, 0x32, 0x02, 0x1A, 0xC6,
-									0x4B, 0xC7, 0x1B, 0x68, 0x33, 0xEE, 0xDF, 0x03,
-									0x64, 0x04, 0xE0, 0x0E, 0x34, 0x8D, 0x81, 0xEF,
-									0x4C, 0x71, 0x08, 0xC8, 0xF8, 0x69, 0x1C, 0xC1,
-									0x7D, 0xC2, 0x1D, 0xB5, 0xF9, 0xB9, 0x27, 0x6A,
-									0x4D, 0xE4, 0xA6, 0x72, 0x9A, 0xC9, 0x09, 0x78,
-									0x65, 0x2F, 0x8A, 0x05, 0x21, 0x0F, 0xE1, 0x24,
-									0x12, 0xF0, 0x82, 0x45, 0x35, 0x93, 0xDA, 0x8E,
-									0x96, 0x8F, 0xDB, 0xBD, 0x36, 0xD0, 0xCE, 0x94,
-									0x13, 0x5C, 0xD2, 0xF1, 0x40, 0x46, 0x83, 0x38,
-									0x66, 0xDD, 0xFD, 0x30, 0xBF, 0x06, 0x8B, 0x62,
-									0xB3, 0x25, 0xE2, 0x98, 0x22, 0x88, 0x91, 0x10,
-									0x7E, 0x6E, 0x48, 0xC3, 0xA3, 0xB6, 0x1E, 0x42,
-									0x3A, 0x6B, 0x28, 0x54, 0xFA, 0x85, 0x3D, 0xBA,
-									0x2B, 0x79, 0x0A, 0x15, 0x9B, 0x9F, 0x5E, 0xCA,
-									0x4E, 0xD4, 0xAC, 0xE5, 0xF3, 0x73, 0xA7, 0x57,
-									0xAF, 0x58, 0xA8, 0x50, 0xF4, 0xEA, 0xD6, 0x74,
-									0x4F, 0xAE, 0xE9, 0xD5, 0xE7, 0xE6, 0xAD, 0xE8,
-									0x2C, 0xD7, 0x75, 0x7A, 0xEB, 0x16, 0x0B, 0xF5,
-									0x59, 0xCB, 0x5F, 0xB0, 0x9C, 0xA9, 0x51, 0xA0,
-									0x7F, 0x0C, 0xF6, 0x6F, 0x17, 0xC4, 0x49, 0xEC,
-									0xD8, 0x43, 0x1F, 0x2D, 0xA4, 0x76, 0x7B, 0xB7,
-									0xCC, 0xBB, 0x3E, 0x5A, 0xFB, 0x60, 0xB1, 0x86,
-									0x3B, 0x52, 0xA1, 0x6C, 0xAA, 0x55, 0x29, 0x9D,
-									0x97, 0xB2, 0x87, 0x90, 0x61, 0xBE, 0xDC, 0xFC,
-									0xBC, 0x95, 0xCF, 0xCD, 0x37, 0x3F, 0x5B, 0xD1,
-									0x53, 0x39, 0x84, 0x3C, 0x41, 0xA2, 0x6D, 0x47,
-									0x14, 0x2A, 0x9E, 0x5D, 0x56, 0xF2, 0xD3, 0xAB,
-									0x44, 0x11, 0x92, 0xD9, 0x23, 0x20, 0x2E, 0x89,
-									0xB4, 0x7C, 0xB8, 0x26, 0x77, 0x99, 0xE3, 0xA5,
-									0x67, 0x4A, 0xED, 0xDE, 0xC5, 0x31, 0xFE, 0x18,
-									0x0D, 0x63, 0x8C, 0x80, 0xC0, 0xF7, 0x70, 0x07 };
-//The inverse logarithm
-static const uint8_t EXP[0x100] = { 0x01, 0x03, 0x05, 0x0F, 0x11, 0x33, 0x55, 0xFF,
-									0x1A, 0x2E, 0x72, 0x96, 0xA1, 0xF8, 0x13, 0x35,
-									0x5F, 0xE1, 0x38, 0x48, 0xD8, 0x73, 0x95, 0xA4,
-									0xF7, 0x02, 0x06, 0x0A, 0x1E, 0x22, 0x66, 0xAA,
-									0xE5, 0x34, 0x5C, 0xE4, 0x37, 0x59, 0xEB, 0x26,
-									0x6A, 0xBE, 0xD9, 0x70, 0x90, 0xAB, 0xE6, 0x31,
-									0x53, 0xF5, 0x04, 0x0C, 0x14, 0x3C, 0x44, 0xCC,
-									0x4F, 0xD1, 0x68, 0xB8, 0xD3, 0x6E, 0xB2, 0xCD,
-									0x4C, 0xD4, 0x67, 0xA9, 0xE0, 0x3B, 0x4D, 0xD7,
-									0x62, 0xA6, 0xF1, 0x08, 0x18, 0x28, 0x78, 0x88,
-									0x83, 0x9E, 0xB9, 0xD0, 0x6B, 0xBD, 0xDC, 0x7F,
-									0x81, 0x98, 0xB3, 0xCE, 0x49, 0xDB, 0x76, 0x9A,
-									0xB5, 0xC4, 0x57, 0xF9, 0x10, 0x30, 0x50, 0xF0,
-									0x0B, 0x1D, 0x27, 0x69, 0xBB, 0xD6, 0x61, 0xA3,
-									0xFE, 0x19, 0x2B, 0x7D, 0x87, 0x92, 0xAD, 0xEC,
-									0x2F, 0x71, 0x93, 0xAE, 0xE9, 0x20, 0x60, 0xA0,
-									0xFB, 0x16, 0x3A, 0x4E, 0xD2, 0x6D, 0xB7, 0xC2,
-									0x5D, 0xE7, 0x32, 0x56, 0xFA, 0x15, 0x3F, 0x41,
-									0xC3, 0x5E, 0xE2, 0x3D, 0x47, 0xC9, 0x40, 0xC0,
-									0x5B, 0xED, 0x2C, 0x74, 0x9C, 0xBF, 0xDA, 0x75,
-									0x9F, 0xBA, 0xD5, 0x64, 0xAC, 0xEF, 0x2A, 0x7E,
-									0x82, 0x9D, 0xBC, 0xDF, 0x7A, 0x8E, 0x89, 0x80,
-									0x9B, 0xB6, 0xC1, 0x58, 0xE8, 0x23, 0x65, 0xAF,
-									0xEA, 0x25, 0x6F, 0xB1, 0xC8, 0x43, 0xC5, 0x54,
-									0xFC, 0x1F, 0x21, 0x63, 0xA5, 0xF4, 0x07, 0x09,
-									0x1B, 0x2D, 0x77, 0x99, 0xB0, 0xCB, 0x46, 0xCA,
-									0x45, 0xCF, 0x4A, 0xDE, 0x79, 0x8B, 0x86, 0x91,
-									0xA8, 0xE3, 0x3E, 0x42, 0xC6, 0x51, 0xF3, 0x0E,
-									0x12, 0x36, 0x5A, 0xEE, 0x29, 0x7B, 0x8D, 0x8C,
-									0x8F, 0x8A, 0x85, 0x94, 0xA7, 0xF2, 0x0D, 0x17,
-									0x39, 0x4B, 0xDD, 0x7C, 0x84, 0x97, 0xA2, 0xFD,
-									0x1C, 0x24, 0x6C, 0xB4, 0xC7, 0x52, 0xF6, 0x01 };
+inline constexpr const uint8_t (&LOG)[0x100] = gf256_detail::LOG_TABLES.log;
+//The inverse logarithm, EXP[i] = EXP[i + 0xFF] for i in [0, 0x101)
+inline constexpr const uint8_t (&EXP)[0x200] = gf256_detail::LOG_TABLES.exp;
 
 
 
 //Interpret a and b as polynomials
-uint8_t div(uint16_t a, uint8_t b);
+constexpr uint8_t div(uint16_t a, uint8_t b);
 //Interpret a and b as polynomials
-uint8_t mod(uint16_t a, uint8_t b);
+constexpr uint8_t mod(uint16_t a, uint8_t b);
 
 
 
@@ -90,30 +82,30 @@ uint8_t mod(uint16_t a, uint8_t b);
 class GF256
 {
 public:
-	GF256();
-	GF256(uint8_t v);
-	GF256(const GF256& other);
-
-	GF256& operator=(const GF256& other);
-	GF256& operator+=(const GF256& other);
-	GF256& operator-=(const GF256& other);
-	GF256& operator*=(const GF256& other);
-	GF256& operator/=(const GF256& other);	//Undefined behavioir if other == 0
-	GF256& operator%=(const GF256& other);
-	GF256 operator+(GF256 other) const;
-	GF256 operator-(GF256 other) const;
-	GF256 operator*(GF256 other) const;
-	GF256 operator/(const GF256& other) const;
-	GF256 operator%(const GF256& other) const;
-	GF256 operator-() const;
-	bool operator==(const GF256& other) const;
-	bool operator!=(const GF256& other) const;
+	constexpr GF256();
+	constexpr GF256(uint8_t v);
+	constexpr GF256(const GF256& other);
+
+	constexpr GF256& operator=(const GF256& other);
+	constexpr GF256& operator+=(const GF256& other);
+	constexpr GF256& operator-=(const GF256& other);
+	constexpr GF256& operator*=(const GF256& other);
+	constexpr GF256& operator/=(const GF256& other);	//Undefined behavioir if other == 0
+	constexpr GF256& operator%=(const GF256& other);
+	constexpr GF256 operator+(GF256 other) const;
+	constexpr GF256 operator-(GF256 other) const;
+	constexpr GF256 operator*(GF256 other) const;
+	constexpr GF256 operator/(const GF256& other) const;
+	constexpr GF256 operator%(const GF256& other) const;
+	constexpr GF256 operator-() const;
+	constexpr bool operator==(const GF256& other) const;
+	constexpr bool operator!=(const GF256& other) const;
 
 	friend std::ostream& operator<<(std::ostream& os, const GF256& gf);
 
-	GF256 inverse() const;
+	constexpr GF256 inverse() const;	//Undefined behavioir if *this == 0
 
-	uint8_t as_int() const;
+	constexpr uint8_t as_int() const;
 
 
 private:
@@ -121,7 +113,38 @@ private:
 };
 
 
-uint8_t div(uint16_t a, uint8_t b)
+
+#ifdef GF256_PRODUCT_TABLE
+//If GF256_PRODUCT_TABLE is defined, multiplications look up the product in a table of all 256 x 256 products (64 KiB)
+//instead of adding logarithms. This only pays off if the table stays in the cache.
+namespace gf256_detail
+{
+	struct ProductTable
+	{
+		uint8_t products[0x100][0x100];
+	};
+
+
+	constexpr ProductTable make_product_table()
+	{
+		ProductTable table{};
+		for (int a = 1; a < 0x100; ++a)
+			for (int b = 1; b < 0x100; ++b)
+				table.products[a][b] = EXP[LOG[a] + LOG[b]];
+		return table;
+	}
+
+
+	inline constexpr ProductTable PRODUCT_TABLE = make_product_table();
+}
+
+
+//MUL[a][b] = a * b
+inline constexpr const uint8_t (&MUL)[0x100][0x100] = gf256_detail::PRODUCT_TABLE.products;
+#endif
+
+
+constexpr uint8_t div(uint16_t a, uint8_t b)
 {
 	char deg_a = 15;
 	while (deg_a > 0 && !(a & (1 << deg_a))) --deg_a;
@@ -139,7 +162,7 @@ uint8_t div(uint16_t a, uint8_t b)
 }
 
 
-uint8_t mod(uint16_t a, uint8_t b)
+constexpr uint8_t mod(uint16_t a, uint8_t b)
 {
 	uint8_t d = div(a, b);
 	uint16_t prod = 0;
@@ -150,90 +173,91 @@ uint8_t mod(uint16_t a, uint8_t b)
 }
 
 
-GF256::GF256() : value(0)
+constexpr GF256::GF256() : value(0)
 {
 }
 
 
-GF256::GF256(uint8_t v) : value(v)
+constexpr GF256::GF256(uint8_t v) : value(v)
 {
 }
 
 
-GF256::GF256(const GF256& other) : value(other.value)
+constexpr GF256::GF256(const GF256& other) : value(other.value)
 {
 }
 
 
-GF256& GF256::operator=(const GF256& other)
+constexpr GF256& GF256::operator=(const GF256& other)
 {
 	value = other.value;
 	return *this;
 }
 
 
-GF256& GF256::operator+=(const GF256& other)
+constexpr GF256& GF256::operator+=(const GF256& other)
 {
 	value ^= other.value;
 	return *this;
 }
 
 
-GF256& GF256::operator-=(const GF256& other)
+constexpr GF256& GF256::operator-=(const GF256& other)
 {
 	value ^= other.value;
 	return *this;
 }
 
 
-GF256& GF256::operator*=(const GF256& other)
+constexpr GF256& GF256::operator*=(const GF256& other)
 {
-	if (value == 0 || other.value == 0)
-		value = 0;
-	else {
-		uint8_t exp = (LOG[value] + LOG[other.value]) % 0xFF;
-		value = EXP[exp];
-	}
+#ifdef GF256_PRODUCT_TABLE
+	value = MUL[value][other.value];
+#else
+	//The product is computed for zero operands as well and then masked out
+	const uint8_t mask = uint8_t(-uint8_t((value != 0) & (other.value != 0)));
+	value = EXP[LOG[value] + LOG[other.value]] & mask;
+#endif
 	return *this;
 }
 
 
-GF256& GF256::operator/=(const GF256& other)
+constexpr GF256& GF256::operator/=(const GF256& other)
 {
 	*this *= other.inverse();
 	return *this;
 }
 
 
-GF256& GF256::operator%=(const GF256& other)
+constexpr GF256& GF256::operator%=(const GF256& other)
 {
 	value = mod(value, other.value);
 	return *this;
 }
 
 
-GF256 GF256::operator+(GF256 other) const
+constexpr GF256 GF256::operator+(GF256 other) const
 {
 	other += *this;
 	return other;
 }
 
 
-GF256 GF256::operator-(GF256 other) const
+constexpr GF256 GF256::operator-(GF256 other) const
 {
 	other -= *this;
 	return other;
 }
 
 
-GF256 GF256::operator*(GF256 other) const
+constexpr GF256 GF256::operator*(GF256 other) const
 {
 	other *= *this;
 	return other;
 }
 
 
-GF256 GF256::operator/(const GF256& other) const
+constexpr GF256 GF256::operator/(const GF256& other) const
 {
 	GF256 result(*this);
 	result /= other;
@@ -241,7 +265,7 @@ GF256 GF256::operator/(const GF256& other) const
 }
 
 
-GF256 GF256::operator%(const GF256& other) const
+constexpr GF256 GF256::operator%(const GF256& other) const
 {
 	GF256 result(*this);
 	result %= other;
@@ -249,26 +273,26 @@ GF256 GF256::operator%(const GF256& other) const
 }
 
 
-GF256 GF256::operator-() const
+constexpr GF256 GF256::operator-() const
 {
 	return GF256(value);
 }
 
 
-bool GF256::operator==(const GF256& other) const
+constexpr bool GF256::operator==(const GF256& other) const
 {
 	return value == other.value;
 }
 
 
-bool GF256::operator!=(const GF256& other) const
+constexpr bool GF256::operator!=(const GF256& other) const
 {
 	return !(*this == other);
 }
 
 
 
-std::ostream& operator<<(std::ostream& os, const GF256& gf)
+inline std::ostream& operator<<(std::ostream& os, const GF256& gf)
 {
 	bool needs_plus = false;
 	for (int i = 7; i > 0; --i)
@@ -283,15 +307,955 @@ std::ostream& operator<<(std::ostream& os, const GF256& gf)
 
 
 
-uint8_t GF256::as_int() const
+constexpr uint8_t GF256::as_int() const
 {
 	return value;
 }
 
 
 
-GF256 GF256::inverse() const
+constexpr GF256 GF256::inverse() const
+{
+	assert(value != 0 && "0 has no inverse");
+	return GF256(EXP[0xFF - LOG[value]]);
+}
+
+
+//Region operations: Every byte of a buffer is interpreted as an element of GF(256)
+//The multiplication with a constant c is split up into the products of c with the low and the high nibble
+//of every byte, which are looked up in two tables with 16 entries. With SSSE3, AVX2 or NEON the lookups are done
+//for 16 or 32 bytes at once with a single shuffle instruction. The fastest kernel supported by the CPU is chosen at runtime.
+
+//dst[i] = c * src[i] for i in [0, len)
+//dst and src may be the same buffer, but must not overlap otherwise
+inline void gf256_mul_region(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len);
+//dst[i] += c * src[i] for i in [0, len)
+//dst and src must not overlap
+inline void gf256_muladd_region(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len);
+
+
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GF256_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define GF256_TARGET(isa)
+#else
+#define GF256_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define GF256_NEON
+#include <arm_neon.h>
+#endif
+
+
+namespace gf256_detail
+{
+	//The products of a constant with every possible value of the low and the high nibble of a byte
+	struct NibbleTables
+	{
+		alignas(16) uint8_t low[16];
+		alignas(16) uint8_t high[16];
+	};
+
+
+	inline NibbleTables nibble_tables(uint8_t c)
+	{
+		NibbleTables tables;
+		for (uint8_t i = 0; i < 16; ++i) {
+			tables.low[i] = (GF256(c) * GF256(i)).as_int();
+			tables.high[i] = (GF256(c) * GF256(i << 4)).as_int();
+		}
+		return tables;
+	}
+
+
+	template<bool Accumulate>
+	inline void region_scalar(uint8_t* dst, const uint8_t* src, const NibbleTables& tables, size_t len)
+	{
+		for (size_t i = 0; i < len; ++i) {
+			const uint8_t product = tables.low[src[i] & 0x0F] ^ tables.high[src[i] >> 4];
+			dst[i] = Accumulate ? dst[i] ^ product : product;
+		}
+	}
+
+
+#if defined(GF256_X86)
+	template<bool Accumulate>
+	GF256_TARGET("ssse3") inline void region_ssse3(uint8_t* dst, const uint8_t* src, const NibbleTables& tables, size_t len)
+	{
+		const __m128i low = _mm_load_si128((const __m128i*)tables.low);
+		const __m128i high = _mm_load_si128((const __m128i*)tables.high);
+		const __m128i mask = _mm_set1_epi8(0x0F);
+		size_t i = 0;
+		for (; i + 16 <= len; i += 16) {
+			const __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(x, mask)),
+			                                _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+			if (Accumulate)
+				product = _mm_xor_si128(product, _mm_loadu_si128((const __m128i*)(dst + i)));
+			_mm_storeu_si128((__m128i*)(dst + i), product);
+		}
+		region_scalar<Accumulate>(dst + i, src + i, tables, len - i);
+	}
+
+
+	template<bool Accumulate>
+	GF256_TARGET("avx2") inline void region_avx2(uint8_t* dst, const uint8_t* src, const NibbleTables& tables, size_t len)
+	{
+		const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)tables.low));
+		const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)tables.high));
+		const __m256i mask = _mm256_set1_epi8(0x0F);
+		size_t i = 0;
+		for (; i + 32 <= len; i += 32) {
+			const __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+			__m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(x, mask)),
+			                                   _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+			if (Accumulate)
+				product = _mm256_xor_si256(product, _mm256_loadu_si256((const __m256i*)(dst + i)));
+			_mm256_storeu_si256((__m256i*)(dst + i), product);
+		}
+		region_ssse3<Accumulate>(dst + i, src + i, tables, len - i);
+	}
+#endif
+
+
+#if defined(GF256_NEON)
+	template<bool Accumulate>
+	inline void region_neon(uint8_t* dst, const uint8_t* src, const NibbleTables& tables, size_t len)
+	{
+		const uint8x16_t low = vld1q_u8(tables.low);
+		const uint8x16_t high = vld1q_u8(tables.high);
+		const uint8x16_t mask = vdupq_n_u8(0x0F);
+		size_t i = 0;
+		for (; i + 16 <= len; i += 16) {
+			const uint8x16_t x = vld1q_u8(src + i);
+			uint8x16_t product = veorq_u8(vqtbl1q_u8(low, vandq_u8(x, mask)), vqtbl1q_u8(high, vshrq_n_u8(x, 4)));
+			if (Accumulate)
+				product = veorq_u8(product, vld1q_u8(dst + i));
+			vst1q_u8(dst + i, product);
+		}
+		region_scalar<Accumulate>(dst + i, src + i, tables, len - i);
+	}
+#endif
+
+
+	enum class Isa { SCALAR, SSSE3, AVX2, NEON };
+
+
+	//Returns the best instruction set supported by the CPU the program runs on
+	inline Isa detect_isa()
+	{
+#if defined(GF256_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		const int max_leaf = info[0];
+		__cpuid(info, 1);
+		const bool ssse3 = info[2] & (1 << 9);
+		const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+		bool avx2 = false;
+		if (max_leaf >= 7 && os_avx) {
+			__cpuidex(info, 7, 0);
+			avx2 = info[1] & (1 << 5);
+		}
+#else
+		__builtin_cpu_init();
+		const bool ssse3 = __builtin_cpu_supports("ssse3");
+		const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+		return avx2 ? Isa::AVX2 : ssse3 ? Isa::SSSE3 : Isa::SCALAR;
+#elif defined(GF256_NEON)
+		return Isa::NEON;
+#else
+		return Isa::SCALAR;
+#endif
+	}
+
+
+	//The CPU is only queried once
+	inline Isa isa()
+	{
+		static const Isa supported = detect_isa();
+		return supported;
+	}
+
+
+	template<bool Accumulate>
+	inline void region(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len)
+	{
+		const NibbleTables tables = nibble_tables(c);
+		switch (isa()) {
+#if defined(GF256_X86)
+		case Isa::AVX2:
+			region_avx2<Accumulate>(dst, src, tables, len);
+			break;
+		case Isa::SSSE3:
+			region_ssse3<Accumulate>(dst, src, tables, len);
+			break;
+#endif
+#if defined(GF256_NEON)
+		case Isa::NEON:
+			region_neon<Accumulate>(dst, src, tables, len);
+			break;
+#endif
+		default:
+			region_scalar<Accumulate>(dst, src, tables, len);
+		}
+	}
+}
+
+
+inline void gf256_mul_region(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len)
+{
+	if (c == 0)
+		std::memset(dst, 0, len);
+	else if (c == 1)
+		std::memmove(dst, src, len);
+	else
+		gf256_detail::region<false>(dst, src, c, len);
+}
+
+
+inline void gf256_muladd_region(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len)
+{
+	if (c != 0)
+		gf256_detail::region<true>(dst, src, c, len);
+}
+
+
+
+//Polynomial over GF(256), coefficient i belongs to x^i
+//The coefficients are stored as contiguous bytes, so the arithmetic can use the region kernels above
+class GF256Poly
 {
-	uint8_t exp = 255 - LOG[value];
-	return GF256(EXP[exp]);
-}
\ No newline at end of file
+public:
+	GF256Poly();
+	explicit GF256Poly(std::vector<uint8_t> coefficients);
+
+	int degree() const;	//-1 for the zero polynomial
+	size_t size() const;
+	const uint8_t* data() const;
+	GF256 operator[](size_t i) const;	//0 for i > degree()
+
+	//Evaluates the polynomial with Horner's method
+	GF256 evaluate(GF256 x) const;
+	//results[j] = p(points[j]) for j in [0, n)
+	//The points are processed in blocks whose results stay in the L1 cache, while Horner's method
+	//is performed in the log domain for all points of a block at once
+	void evaluate(const uint8_t* points, uint8_t* results, size_t n) const;
+
+	GF256Poly& operator+=(const GF256Poly& other);
+	GF256Poly& operator-=(const GF256Poly& other);
+	GF256Poly& operator*=(GF256 c);
+	GF256Poly operator+(const GF256Poly& other) const;
+	GF256Poly operator-(const GF256Poly& other) const;
+	GF256Poly operator*(const GF256Poly& other) const;
+	GF256Poly operator*(GF256 c) const;
+	GF256Poly operator/(const GF256Poly& other) const;	//Undefined behavioir if other == 0
+	GF256Poly operator%(const GF256Poly& other) const;	//Undefined behavioir if other == 0
+	bool operator==(const GF256Poly& other) const;
+	bool operator!=(const GF256Poly& other) const;
+
+	//Returns the quotient and the remainder of the division by divisor (divisor != 0)
+	std::pair<GF256Poly, GF256Poly> divmod(const GF256Poly& divisor) const;
+
+
+private:
+	std::vector<uint8_t> coefficients;	//Without leading zero coefficients
+
+	void trim();
+};
+
+
+
+//Dense matrix over GF(256), stored row by row in a contiguous buffer
+class GF256Matrix
+{
+public:
+	GF256Matrix();
+	GF256Matrix(size_t rows, size_t cols);	//All elements are 0
+	GF256Matrix(size_t rows, size_t cols, std::vector<uint8_t> elements);
+
+	static GF256Matrix identity(size_t n);
+	//Cauchy matrix with elements 1 / (x_i + y_j), all x_i and y_j have to be distinct
+	static GF256Matrix cauchy(const std::vector<uint8_t>& x, const std::vector<uint8_t>& y);
+
+	size_t rows() const;
+	size_t cols() const;
+	uint8_t& operator()(size_t row, size_t col);
+	uint8_t operator()(size_t row, size_t col) const;
+	uint8_t* row(size_t i);
+	const uint8_t* row(size_t i) const;
+
+	GF256Matrix operator*(const GF256Matrix& other) const;
+	bool operator==(const GF256Matrix& other) const;
+	bool operator!=(const GF256Matrix& other) const;
+
+	//Returns the matrix consisting of the given rows of this matrix
+	GF256Matrix select_rows(const std::vector<uint8_t>& indices) const;
+	//Inverts the square matrix in place with Gauss-Jordan elimination, the row operations use the region kernels
+	//Returns false (and leaves the matrix in an unspecified state) if the matrix is singular
+	bool invert();
+
+	//Multiplies the matrix with a matrix whose rows are the cols() buffers of len bytes in inputs
+	//and writes the rows() rows of the result to outputs: outputs[i] = sum_j (*this)(i, j) * inputs[j]
+	//The outputs are computed in tiles of TILE bytes, so they stay in the L1 cache while all inputs are added
+	void apply(const uint8_t* const* inputs, uint8_t* const* outputs, size_t len) const;
+
+
+private:
+	static constexpr size_t TILE = 16384;
+
+	size_t num_rows;
+	size_t num_cols;
+	std::vector<uint8_t> elements;
+};
+
+
+
+//Systematic Reed-Solomon erasure code with k data shards and m parity shards (k + m <= 256)
+//The parity shards are computed with a k x m Cauchy matrix. As every square submatrix of a Cauchy matrix
+//is invertible, the data can be reconstructed from any k of the k + m shards.
+//All shards have the same length and are processed with the region kernels above.
+class ReedSolomon
+{
+public:
+	ReedSolomon(unsigned k, unsigned m);
+
+	unsigned data_shards() const;
+	unsigned parity_shards() const;
+
+	//Computes the m parity shards from the k data shards, every shard consists of len bytes
+	void encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const;
+	//shards contains the k data shards followed by the m parity shards and present[i] tells
+	//whether shard i is available. The missing shards are reconstructed and written to shards[i].
+	//Returns false if less than k shards are available.
+	//The inverted matrices are cached for every erasure pattern, so reconstructing many stripes
+	//with the same missing shards only inverts a matrix once
+	bool reconstruct(uint8_t* const* shards, const bool* present, size_t len) const;
+
+
+private:
+	unsigned k;
+	unsigned m;
+	GF256Matrix generator;	//(k + m) x k matrix [I; C]
+	mutable std::map<std::vector<uint8_t>, GF256Matrix> decode_matrices;	//The inverse of the rows of the generator used for decoding
+	mutable std::mutex decode_matrices_mutex;
+};
+
+
+
+//---------- GF256Poly Implementation ----------//
+
+inline GF256Poly::GF256Poly()
+{
+}
+
+
+inline GF256Poly::GF256Poly(std::vector<uint8_t> coefficients) : coefficients(std::move(coefficients))
+{
+	trim();
+}
+
+
+inline int GF256Poly::degree() const
+{
+	return int(coefficients.size()) - 1;
+}
+
+
+inline size_t GF256Poly::size() const
+{
+	return coefficients.size();
+}
+
+
+inline const uint8_t* GF256Poly::data() const
+{
+	return coefficients.data();
+}
+
+
+inline GF256 GF256Poly::operator[](size_t i) const
+{
+	return i < coefficients.size() ? GF256(coefficients[i]) : GF256(0);
+}
+
+
+inline GF256 GF256Poly::evaluate(GF256 x) const
+{
+	GF256 result;
+	for (size_t i = coefficients.size(); i-- > 0;)
+		result = result * x + GF256(coefficients[i]);
+	return result;
+}
+
+
+inline void GF256Poly::evaluate(const uint8_t* points, uint8_t* results, size_t n) const
+{
+	constexpr size_t BLOCK = 256;
+	uint8_t log_x[BLOCK];
+	uint8_t nonzero_x[BLOCK];
+	for (size_t first = 0; first < n; first += BLOCK) {
+		const size_t count = std::min(BLOCK, n - first);
+		uint8_t* r = results + first;
+		for (size_t j = 0; j < count; ++j) {
+			log_x[j] = LOG[points[first + j]];
+			nonzero_x[j] = uint8_t(-uint8_t(points[first + j] != 0));
+		}
+		if (coefficients.empty()) {
+			std::memset(r, 0, count);
+			continue;
+		}
+		std::fill_n(r, count, coefficients.back());
+		for (size_t i = coefficients.size() - 1; i-- > 0;) {
+			const uint8_t c = coefficients[i];
+			for (size_t j = 0; j < count; ++j) {
+				//r[j] * x_j + c without branching on zero operands
+				const uint8_t mask = nonzero_x[j] & uint8_t(-uint8_t(r[j] != 0));
+				r[j] = uint8_t((EXP[LOG[r[j]] + log_x[j]] & mask) ^ c);
+			}
+		}
+	}
+}
+
+
+inline GF256Poly& GF256Poly::operator+=(const GF256Poly& other)
+{
+	if (other.coefficients.size() > coefficients.size())
+		coefficients.resize(other.coefficients.size(), 0);
+	for (size_t i = 0; i < other.coefficients.size(); ++i)
+		coefficients[i] ^= other.coefficients[i];
+	trim();
+	return *this;
+}
+
+
+inline GF256Poly& GF256Poly::operator-=(const GF256Poly& other)
+{
+	return *this += other;
+}
+
+
+inline GF256Poly& GF256Poly::operator*=(GF256 c)
+{
+	gf256_mul_region(coefficients.data(), coefficients.data(), c.as_int(), coefficients.size());
+	trim();
+	return *this;
+}
+
+
+inline GF256Poly GF256Poly::operator+(const GF256Poly& other) const
+{
+	GF256Poly result(*this);
+	result += other;
+	return result;
+}
+
+
+inline GF256Poly GF256Poly::operator-(const GF256Poly& other) const
+{
+	return *this + other;
+}
+
+
+inline GF256Poly GF256Poly::operator*(const GF256Poly& other) const
+{
+	if (coefficients.empty() || other.coefficients.empty())
+		return GF256Poly();
+	//Add other * c_i * x^i for every coefficient c_i
+	std::vector<uint8_t> product(coefficients.size() + other.coefficients.size() - 1, 0);
+	for (size_t i = 0; i < coefficients.size(); ++i)
+		gf256_muladd_region(&product[i], other.coefficients.data(), coefficients[i], other.coefficients.size());
+	return GF256Poly(std::move(product));
+}
+
+
+inline GF256Poly GF256Poly::operator*(GF256 c) const
+{
+	GF256Poly result(*this);
+	result *= c;
+	return result;
+}
+
+
+inline GF256Poly GF256Poly::operator/(const GF256Poly& other) const
+{
+	return divmod(other).first;
+}
+
+
+inline GF256Poly GF256Poly::operator%(const GF256Poly& other) const
+{
+	return divmod(other).second;
+}
+
+
+inline bool GF256Poly::operator==(const GF256Poly& other) const
+{
+	return coefficients == other.coefficients;
+}
+
+
+inline bool GF256Poly::operator!=(const GF256Poly& other) const
+{
+	return !(*this == other);
+}
+
+
+inline std::pair<GF256Poly, GF256Poly> GF256Poly::divmod(const GF256Poly& divisor) const
+{
+	assert(!divisor.coefficients.empty() && "Division by the zero polynomial");
+	if (coefficients.size() < divisor.coefficients.size())
+		return std::make_pair(GF256Poly(), *this);
+	const size_t n = divisor.coefficients.size();
+	const GF256 lead_inverse = GF256(divisor.coefficients.back()).inverse();
+	std::vector<uint8_t> remainder(coefficients);
+	std::vector<uint8_t> quotient(coefficients.size() - n + 1);
+	//Eliminate the highest remaining coefficient by subtracting a multiple of the divisor
+	for (size_t i = quotient.size(); i-- > 0;) {
+		const uint8_t q = (GF256(remainder[i + n - 1]) * lead_inverse).as_int();
+		quotient[i] = q;
+		gf256_muladd_region(&remainder[i], divisor.coefficients.data(), q, n);
+	}
+	remainder.resize(n - 1);
+	return std::make_pair(GF256Poly(std::move(quotient)), GF256Poly(std::move(remainder)));
+}
+
+
+inline void GF256Poly::trim()
+{
+	while (!coefficients.empty() && coefficients.back() == 0)
+		coefficients.pop_back();
+}
+
+
+
+//---------- GF256Matrix Implementation ----------//
+
+inline GF256Matrix::GF256Matrix() : num_rows(0), num_cols(0)
+{
+}
+
+
+inline GF256Matrix::GF256Matrix(size_t rows, size_t cols) : num_rows(rows), num_cols(cols), elements(rows * cols, 0)
+{
+}
+
+
+inline GF256Matrix::GF256Matrix(size_t rows, size_t cols, std::vector<uint8_t> elements) :
+	num_rows(rows), num_cols(cols), elements(std::move(elements))
+{
+	assert(this->elements.size() == rows * cols);
+}
+
+
+inline GF256Matrix GF256Matrix::identity(size_t n)
+{
+	GF256Matrix result(n, n);
+	for (size_t i = 0; i < n; ++i)
+		result(i, i) = 1;
+	return result;
+}
+
+
+inline GF256Matrix GF256Matrix::cauchy(const std::vector<uint8_t>& x, const std::vector<uint8_t>& y)
+{
+	GF256Matrix result(x.size(), y.size());
+	for (size_t i = 0; i < x.size(); ++i)
+		for (size_t j = 0; j < y.size(); ++j)
+			result(i, j) = (GF256(x[i]) + GF256(y[j])).inverse().as_int();
+	return result;
+}
+
+
+inline size_t GF256Matrix::rows() const
+{
+	return num_rows;
+}
+
+
+inline size_t GF256Matrix::cols() const
+{
+	return num_cols;
+}
+
+
+inline uint8_t& GF256Matrix::operator()(size_t row, size_t col)
+{
+	return elements[row * num_cols + col];
+}
+
+
+inline uint8_t GF256Matrix::operator()(size_t row, size_t col) const
+{
+	return elements[row * num_cols + col];
+}
+
+
+inline uint8_t* GF256Matrix::row(size_t i)
+{
+	return elements.data() + i * num_cols;
+}
+
+
+inline const uint8_t* GF256Matrix::row(size_t i) const
+{
+	return elements.data() + i * num_cols;
+}
+
+
+inline GF256Matrix GF256Matrix::operator*(const GF256Matrix& other) const
+{
+	assert(num_cols == other.num_rows);
+	//Every row of the result is a linear combination of the rows of other
+	GF256Matrix result(num_rows, other.num_cols);
+	for (size_t i = 0; i < num_rows; ++i)
+		for (size_t j = 0; j < num_cols; ++j)
+			gf256_muladd_region(result.row(i), other.row(j), (*this)(i, j), other.num_cols);
+	return result;
+}
+
+
+inline bool GF256Matrix::operator==(const GF256Matrix& other) const
+{
+	return num_rows == other.num_rows && num_cols == other.num_cols && elements == other.elements;
+}
+
+
+inline bool GF256Matrix::operator!=(const GF256Matrix& other) const
+{
+	return !(*this == other);
+}
+
+
+inline GF256Matrix GF256Matrix::select_rows(const std::vector<uint8_t>& indices) const
+{
+	GF256Matrix result(indices.size(), num_cols);
+	for (size_t i = 0; i < indices.size(); ++i) {
+		assert(indices[i] < num_rows);
+		std::memcpy(result.row(i), row(indices[i]), num_cols);
+	}
+	return result;
+}
+
+
+inline bool GF256Matrix::invert()
+{
+	assert(num_rows == num_cols);
+	const size_t n = num_rows;
+	GF256Matrix inverse = identity(n);
+	for (size_t col = 0; col < n; ++col) {
+		//Find a row with a non-zero pivot
+		size_t pivot = col;
+		while (pivot < n && (*this)(pivot, col) == 0)
+			++pivot;
+		if (pivot == n)
+			return false;
+		if (pivot != col) {
+			std::swap_ranges(row(pivot), row(pivot) + n, row(col));
+			std::swap_ranges(inverse.row(pivot), inverse.row(pivot) + n, inverse.row(col));
+		}
+		//Normalize the pivot row
+		const uint8_t scale = GF256((*this)(col, col)).inverse().as_int();
+		gf256_mul_region(row(col), row(col), scale, n);
+		gf256_mul_region(inverse.row(col), inverse.row(col), scale, n);
+		//Eliminate the column from all other rows
+		for (size_t i = 0; i < n; ++i) {
+			const uint8_t factor = (*this)(i, col);
+			if (i == col || factor == 0)
+				continue;
+			gf256_muladd_region(row(i), row(col), factor, n);
+			gf256_muladd_region(inverse.row(i), inverse.row(col), factor, n);
+		}
+	}
+	elements.swap(inverse.elements);
+	return true;
+}
+
+
+inline void GF256Matrix::apply(const uint8_t* const* inputs, uint8_t* const* outputs, size_t len) const
+{
+	for (size_t offset = 0; offset < len; offset += TILE) {
+		const size_t n = std::min(TILE, len - offset);
+		for (size_t i = 0; i < num_rows; ++i) {
+			if (num_cols == 0) {
+				std::memset(outputs[i] + offset, 0, n);
+				continue;
+			}
+			gf256_mul_region(outputs[i] + offset, inputs[0] + offset, (*this)(i, 0), n);
+			for (size_t j = 1; j < num_cols; ++j)
+				gf256_muladd_region(outputs[i] + offset, inputs[j] + offset, (*this)(i, j), n);
+		}
+	}
+}
+
+
+
+//---------- ReedSolomon Implementation ----------//
+
+inline ReedSolomon::ReedSolomon(unsigned k, unsigned m) : k(k), m(m), generator(k + m, k)
+{
+	assert(k > 0 && k + m <= 256);
+	//x_i = k + i and y_j = j are all distinct
+	std::vector<uint8_t> x(m), y(k);
+	for (unsigned i = 0; i < m; ++i)
+		x[i] = uint8_t(k + i);
+	for (unsigned j = 0; j < k; ++j)
+		y[j] = uint8_t(j);
+	const GF256Matrix cauchy = GF256Matrix::cauchy(x, y);
+	for (unsigned i = 0; i < k; ++i)
+		generator(i, i) = 1;
+	for (unsigned i = 0; i < m; ++i)
+		std::memcpy(generator.row(k + i), cauchy.row(i), k);
+}
+
+
+inline unsigned ReedSolomon::data_shards() const
+{
+	return k;
+}
+
+
+inline unsigned ReedSolomon::parity_shards() const
+{
+	return m;
+}
+
+
+inline void ReedSolomon::encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const
+{
+	std::vector<uint8_t> parity_rows(m);
+	for (unsigned i = 0; i < m; ++i)
+		parity_rows[i] = uint8_t(k + i);
+	generator.select_rows(parity_rows).apply(data, parity, len);
+}
+
+
+inline bool ReedSolomon::reconstruct(uint8_t* const* shards, const bool* present, size_t len) const
+{
+	//Decode from the first k shards which are available
+	std::vector<uint8_t> rows;
+	for (unsigned i = 0; i < k + m && rows.size() < k; ++i)
+		if (present[i])
+			rows.push_back(uint8_t(i));
+	if (rows.size() < k)
+		return false;
+	std::vector<const uint8_t*> sources;
+	for (uint8_t row : rows)
+		sources.push_back(shards[row]);
+	//Reconstruct the missing data shards
+	std::vector<uint8_t> missing;
+	std::vector<uint8_t*> outputs;
+	for (unsigned i = 0; i < k; ++i)
+		if (!present[i]) {
+			missing.push_back(uint8_t(i));
+			outputs.push_back(shards[i]);
+		}
+	if (!missing.empty()) {
+		GF256Matrix decode;
+		{
+			std::lock_guard<std::mutex> lock(decode_matrices_mutex);
+			auto it = decode_matrices.find(rows);
+			if (it == decode_matrices.end()) {
+				GF256Matrix matrix = generator.select_rows(rows);
+				const bool invertible = matrix.invert();
+				assert(invertible && "A square submatrix of [I; C] is always invertible");
+				(void)invertible;
+				it = decode_matrices.emplace(rows, std::move(matrix)).first;
+			}
+			//Only the rows of the missing shards are needed
+			decode = it->second.select_rows(missing);
+		}
+		decode.apply(sources.data(), outputs.data(), len);
+	}
+	//Recompute the missing parity shards from the complete data
+	missing.clear();
+	outputs.clear();
+	for (unsigned i = k; i < k + m; ++i)
+		if (!present[i]) {
+			missing.push_back(uint8_t(i));
+			outputs.push_back(shards[i]);
+		}
+	if (!missing.empty())
+		generator.select_rows(missing).apply(shards, outputs.data(), len);
+	return true;
+}
+
+
+
+//Runs independent jobs (e.g. the encoding of many stripes) on a pool of persistent worker threads
+//The indices of a loop are handed out in chunks from a shared atomic counter, so each worker
+//takes the next chunk as soon as it is done with its previous one and uneven work is balanced.
+//Workers can be pinned to cores, which keeps their tiles in the caches of the core and their memory
+//on the NUMA node they run on. parallel_for must not be called from inside a job.
+class StripeScheduler
+{
+public:
+	//Starts threads workers (0: one per core) which are not pinned
+	explicit StripeScheduler(unsigned threads = 0);
+	//Starts one worker per element of cores, worker i is pinned to core cores[i]
+	explicit StripeScheduler(const std::vector<unsigned>& cores);
+	StripeScheduler(const StripeScheduler& other) = delete;
+	~StripeScheduler();
+
+	StripeScheduler& operator=(const StripeScheduler& other) = delete;
+
+	unsigned threads() const;
+
+	//Calls f(i) for every i in [0, count) on the workers and returns when all calls are done
+	//The workers take chunk consecutive indices at a time
+	template<typename F>
+	void parallel_for(size_t count, F f, size_t chunk = 1);
+	//outputs[i] = sum_j matrix(i, j) * inputs[j] like GF256Matrix::apply, with the buffers split into tiles
+	//such that the tiles of all inputs and outputs a worker processes at once fit into its L2 cache
+	void apply(const GF256Matrix& matrix, const uint8_t* const* inputs, uint8_t* const* outputs, size_t len);
+
+
+private:
+	static constexpr size_t L2_SIZE = 262144;	//Conservative estimate of the L2 cache size per core
+
+	std::vector<std::thread> workers;
+	std::mutex dispatch_mutex;	//Only one loop runs at a time
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	const std::function<void(size_t, size_t)>* job = nullptr;	//Processes the indices in [first, last)
+	size_t job_count = 0;
+	size_t job_chunk = 1;
+	std::atomic<size_t> next{0};	//The first index which has not been handed out yet
+	unsigned generation = 0;	//Incremented for every job
+	unsigned busy = 0;			//Number of workers which have not finished the current job yet
+	bool stop = false;
+
+	void run(const std::function<void(size_t, size_t)>& body, size_t count, size_t chunk);
+	void work();
+	static void pin(std::thread& thread, unsigned core);
+};
+
+
+
+//---------- StripeScheduler Implementation ----------//
+
+inline StripeScheduler::StripeScheduler(unsigned threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < threads; ++i)
+		workers.emplace_back(&StripeScheduler::work, this);
+}
+
+
+inline StripeScheduler::StripeScheduler(const std::vector<unsigned>& cores)
+{
+	assert(!cores.empty());
+	for (unsigned core : cores) {
+		workers.emplace_back(&StripeScheduler::work, this);
+		pin(workers.back(), core);
+	}
+}
+
+
+inline StripeScheduler::~StripeScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	start.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+
+inline unsigned StripeScheduler::threads() const
+{
+	return unsigned(workers.size());
+}
+
+
+template<typename F>
+void StripeScheduler::parallel_for(size_t count, F f, size_t chunk)
+{
+	const std::function<void(size_t, size_t)> body = [&f](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i)
+			f(i);
+	};
+	run(body, count, chunk);
+}
+
+
+inline void StripeScheduler::apply(const GF256Matrix& matrix, const uint8_t* const* inputs, uint8_t* const* outputs, size_t len)
+{
+	const size_t buffers = std::max<size_t>(1, matrix.rows() + matrix.cols());
+	const size_t tile = std::max<size_t>(4096, L2_SIZE / buffers / 64 * 64);
+	const size_t tiles = (len + tile - 1) / tile;
+	parallel_for(tiles, [&](size_t t) {
+		const size_t offset = t * tile;
+		std::vector<const uint8_t*> tile_inputs(matrix.cols());
+		std::vector<uint8_t*> tile_outputs(matrix.rows());
+		for (size_t j = 0; j < matrix.cols(); ++j)
+			tile_inputs[j] = inputs[j] + offset;
+		for (size_t i = 0; i < matrix.rows(); ++i)
+			tile_outputs[i] = outputs[i] + offset;
+		matrix.apply(tile_inputs.data(), tile_outputs.data(), std::min(tile, len - offset));
+	});
+}
+
+
+inline void StripeScheduler::run(const std::function<void(size_t, size_t)>& body, size_t count, size_t chunk)
+{
+	if (count == 0)
+		return;
+	std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex);
+	std::unique_lock<std::mutex> lock(mutex);
+	job = &body;
+	job_count = count;
+	job_chunk = std::max<size_t>(1, chunk);
+	next.store(0, std::memory_order_relaxed);
+	busy = unsigned(workers.size());
+	++generation;
+	start.notify_all();
+	done.wait(lock, [this] { return busy == 0; });
+	job = nullptr;
+}
+
+
+inline void StripeScheduler::work()
+{
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		start.wait(lock, [&] { return stop || generation != seen; });
+		if (stop)
+			return;
+		seen = generation;
+		const std::function<void(size_t, size_t)>& body = *job;
+		const size_t count = job_count;
+		const size_t chunk = job_chunk;
+		lock.unlock();
+		for (size_t first = next.fetch_add(chunk); first < count; first = next.fetch_add(chunk))
+			body(first, std::min(first + chunk, count));
+		lock.lock();
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+
+inline void StripeScheduler::pin(std::thread& thread, unsigned core)
+{
+#if defined(_WIN32)
+	SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
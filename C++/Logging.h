@@ -6,6 +6,21 @@
 #include <ctime>
 #include <iomanip>
 #include <initializer_list>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+
+
+//Identifiers listed in this string are removed at compile time, LOG_WRITE calls using them compile to nothing
+//Define it before including this header, e.g. #define LOG_DISABLED_IDENTIFIERS "mv"
+#ifndef LOG_DISABLED_IDENTIFIERS
+#define LOG_DISABLED_IDENTIFIERS ""
+#endif
 
 
 
@@ -26,29 +41,115 @@
 
   LOG::deactivate(char identifier)
       Deactivate the logging of messages using the given identifier
+
+  LOG::is_active(char identifier)
+      Check without locking if messages using the given identifier are logged
+	  This is always false for the identifiers in LOG_DISABLED_IDENTIFIERS.
+
+  LOG_WRITE(identifier, os, message) OR LOG::write<identifier>(os, make_message)
+      Like LOG::write(message, os, identifier), but the message expression (or the function make_message) is only evaluated
+	  if the identifier is active. If the identifier is listed in LOG_DISABLED_IDENTIFIERS, the call compiles to nothing.
+	  The identifier has to be a compile time constant.
+
+  LOG::start_async(LOG::Overflow overflow, size_t capacity)
+      From now on write only stores the message and its time stamp in a ring buffer of the calling thread (holding capacity messages).
+	  A background thread formats the messages and writes them to their streams in batches.
+	  If a ring buffer is full, write either waits for free space (Overflow::BLOCK) or discards the message (Overflow::DROP).
+	  Messages of one thread keep their order, messages of different threads may be interleaved differently than they were written.
+
+  LOG::stop_async()
+      Write all pending messages and return to writing them directly. This also happens at the end of the program,
+	  call it before destroying a stream which is still used by pending messages.
+
+  LOG::flush()
+      Wait until all messages written by now are in their streams and the streams are flushed.
+
+  LOG::dropped()
+      Number of messages discarded by Overflow::DROP
 */
 
 
 
 class LOG {
+public:
+	//What write does if the ring buffer of the calling thread is full in asynchronous mode
+	enum struct Overflow { BLOCK, DROP };
+
+private:
+	//A message waiting to be written by the background thread
+	struct Record
+	{
+		std::time_t time;
+		std::ostream* os;
+		std::string message;
+	};
+
+
+	//Single producer single consumer ring buffer of Records
+	//The owning thread writes at tail, the background thread reads at head
+	struct Ring
+	{
+		explicit Ring(size_t capacity);
+
+		std::vector<Record> records;
+		const size_t mask;
+		alignas(64) std::atomic<size_t> head;
+		alignas(64) std::atomic<size_t> tail;
+		std::atomic<size_t> dropped;
+		std::atomic<bool> closed;	//The owning thread has exited, the ring can be taken over by a new thread
+		Ring* next;					//Next ring in the list of all rings
+	};
+
+
+	//Marks the ring of a thread as closed when the thread exits
+	struct RingHandle
+	{
+		Ring* ring = nullptr;
+		~RingHandle();
+	};
+
+
 	//This singleton class provides thread safe information on which logging identifiers are active at the moment
 	class Log
 	{
 	public:
-		static Log& instance();	//Get the Log instance (Return the existing one or else construct a new one)
+		static Log& instance();	//Get the Log instance (constructed on first use)
 
 		bool is_active(char identifier) const;	//Provide thread safe access to check if a logging identifier is currently active
 		void activate(char identifier);		//Activate the logging of information using this identifier
 		void deactivate(char identifier);	//Deactivate the logging of information using this identifier
-		bool log(const std::string& message, std::ostream& os) const;	//Write the message to the stream (use the mutex m to make it thread safe)
-		bool log(const std::string& message, std::ostream& os, char identifier) const;
+		bool log(const std::string& message, std::ostream& os);	//Write the message to the stream (use the mutex m to make it thread safe)
+		bool log(const std::string& message, std::ostream& os, char identifier);
+
+		void start_async(Overflow overflow, size_t capacity);
+		void stop_async();
+		void flush() const;
+		size_t dropped() const;
 
 	private:
-		static Log* inst;		//A pointer to an instance of Log
-		bool active[256];		//Stores the currently selected identifiers to log
-		static std::mutex m;	//Make the Log instance thread safe to allow logging of multiple threads
+		std::atomic<bool> active[256];	//Stores the currently selected identifiers to log
+		mutable std::mutex m;	//Make the Log instance thread safe to allow logging of multiple threads
+
+		//Asynchronous mode
+		std::atomic<bool> running;
+		std::atomic<size_t> pushing;	//Number of threads which are storing a message in their ring at the moment
+		Overflow overflow;
+		size_t capacity;
+		std::atomic<Ring*> rings;	//List of the rings of all threads which logged asynchronously
+		std::thread writer;
+		std::mutex wake_mutex;
+		std::condition_variable wake;
 
 		Log();	//Constructor is private as this class is a singleton
+		~Log();
+
+		bool push(const std::string& message, std::ostream& os);	//Store the message in the ring of the calling thread, false if the mode was stopped
+		Ring& local_ring();
+		void run();		//Loop of the background thread
+		size_t drain();	//Write all messages stored in the rings and return their number
+
+		static std::tm local_time(std::time_t t);
+		static void format(std::ostream& os, const std::tm& tm, const std::string& message);
 	};
 
 
@@ -58,10 +159,31 @@ public:
 	static void write(const std::string& message, std::ostream& os, const std::initializer_list<char>& identifiers);
 	static void activate(char identifier);
 	static void deactivate(char identifier);
+	static bool is_active(char identifier);
+	static constexpr bool compiled(char identifier);	//False if the identifier is listed in LOG_DISABLED_IDENTIFIERS
+	template<char Identifier, typename F>
+	static void write(std::ostream& os, F&& make_message);
+
+	static void start_async(Overflow overflow = Overflow::BLOCK, size_t capacity = 1024);
+	static void stop_async();
+	static void flush();
+	static size_t dropped();
 };
 
-LOG::Log* LOG::Log::inst = nullptr;
-std::mutex LOG::Log::m;
+
+
+//---------- LOG::Ring Implementation ----------//
+
+inline LOG::Ring::Ring(size_t capacity) : records(capacity), mask(capacity - 1), head(0), tail(0), dropped(0), closed(false), next(nullptr)
+{
+}
+
+
+inline LOG::RingHandle::~RingHandle()
+{
+	if (ring)
+		ring->closed.store(true, std::memory_order_release);
+}
 
 
 
@@ -69,64 +191,241 @@ std::mutex LOG::Log::m;
 
 inline LOG::Log& LOG::Log::instance()
 {
-	std::lock_guard<std::mutex> guard(m);
-	if (!inst)	//Construct a new instance of Log, if none exists yet
-		inst = new Log();
-	return *inst;
+	static Log inst;
+	return inst;
 }
 
 
 inline bool LOG::Log::is_active(char identifier) const
 {
-	std::lock_guard<std::mutex> guard(m);
-	return active[identifier];
+	//The flags do not guard any other data, so relaxed loads are enough
+	return compiled(identifier) && active[static_cast<unsigned char>(identifier)].load(std::memory_order_relaxed);
 }
 
 
 inline void LOG::Log::activate(char identifier)
 {
-	std::lock_guard<std::mutex> guard(m);
-	active[identifier] = true;
+	active[static_cast<unsigned char>(identifier)].store(true, std::memory_order_relaxed);
 }
 
 
 inline void LOG::Log::deactivate(char identifier)
 {
-	std::lock_guard<std::mutex> guard(m);
-	active[identifier] = false;
+	active[static_cast<unsigned char>(identifier)].store(false, std::memory_order_relaxed);
 }
 
 
-LOG::Log::Log()
+inline LOG::Log::Log() : running(false), pushing(0), overflow(Overflow::BLOCK), capacity(1024), rings(nullptr)
 {
 	//Fill the active identifiers array with false
-	for (bool& f : active)
-		f = false;
+	for (std::atomic<bool>& f : active)
+		f.store(false, std::memory_order_relaxed);
 }
 
 
-inline bool LOG::Log::log(const std::string& message, std::ostream& os) const
+inline LOG::Log::~Log()
 {
+	stop_async();
+	drain();
+	Ring* ring = rings.load();
+	while (ring) {
+		Ring* next = ring->next;
+		delete ring;
+		ring = next;
+	}
+}
+
+
+inline bool LOG::Log::log(const std::string& message, std::ostream& os)
+{
+	if (running.load(std::memory_order_acquire)) {
+		//Announce the push before checking running again, such that stop_async either waits for it
+		//or this thread sees that the mode was stopped (both sides use sequentially consistent operations)
+		pushing.fetch_add(1);
+		const bool stored = running.load() && push(message, os);
+		pushing.fetch_sub(1, std::memory_order_release);
+		if (stored)
+			return true;
+	}
+	//stop_async holds m while writing the remaining records, so this message is written after them
 	std::lock_guard<std::mutex> guard(m);
-	std::time_t t = std::time(nullptr);
-	std::tm tm;
-	localtime_s(&tm, &t);
-	os << "[" << std::put_time(&tm, "%T") << "] -> " << message << std::endl;
+	format(os, local_time(std::time(nullptr)), message);
+	os << std::flush;
 	return true;
 }
 
 
-inline bool LOG::Log::log(const std::string& message, std::ostream& os, char identifier) const
+inline bool LOG::Log::log(const std::string& message, std::ostream& os, char identifier)
+{
+	if (!is_active(identifier))
+		return false;
+	log(message, os);
+	return true;
+}
+
+
+inline void LOG::Log::start_async(Overflow overflow, size_t capacity)
+{
+	std::lock_guard<std::mutex> guard(m);
+	if (running.load())
+		return;
+	this->overflow = overflow;
+	//Round the capacity up to a power of two
+	this->capacity = 1;
+	while (this->capacity < capacity)
+		this->capacity *= 2;
+	running.store(true, std::memory_order_release);
+	writer = std::thread(&Log::run, this);
+}
+
+
+inline void LOG::Log::stop_async()
 {
 	std::lock_guard<std::mutex> guard(m);
-	if (active[identifier]) {
-		std::time_t t = std::time(nullptr);
-		std::tm tm;
-		localtime_s(&tm, &t);
-		os << "[" << std::put_time(&tm, "%T") << "] -> " << message << std::endl;
-		return true;
+	if (!running.load())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		running.store(false);
+	}
+	wake.notify_one();
+	writer.join();
+	//Wait for the threads which saw the mode running and write what they stored
+	//Every later write goes the synchronous way, so no record is left behind in the rings
+	while (pushing.load(std::memory_order_acquire))
+		std::this_thread::yield();
+	drain();
+}
+
+
+inline void LOG::Log::flush() const
+{
+	//Wait until the background thread consumed everything which was stored by now
+	for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+		const size_t tail = ring->tail.load(std::memory_order_acquire);
+		while (ring->head.load(std::memory_order_acquire) < tail && running.load(std::memory_order_acquire))
+			std::this_thread::yield();
 	}
-	return false;
+}
+
+
+inline size_t LOG::Log::dropped() const
+{
+	size_t count = 0;
+	for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+		count += ring->dropped.load(std::memory_order_relaxed);
+	return count;
+}
+
+
+inline bool LOG::Log::push(const std::string& message, std::ostream& os)
+{
+	Ring& ring = local_ring();
+	const size_t tail = ring.tail.load(std::memory_order_relaxed);
+	while (tail - ring.head.load(std::memory_order_acquire) > ring.mask) {
+		if (overflow == Overflow::DROP) {
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		//Nobody frees a slot once the background thread stopped, so write the message synchronously
+		if (!running.load(std::memory_order_acquire))
+			return false;
+		std::this_thread::yield();
+	}
+	//Copying into the record reuses the memory of the message previously stored there
+	Record& record = ring.records[tail & ring.mask];
+	record.time = std::time(nullptr);
+	record.os = &os;
+	record.message = message;
+	ring.tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+
+inline LOG::Ring& LOG::Log::local_ring()
+{
+	thread_local RingHandle handle;
+	if (handle.ring)
+		return *handle.ring;
+	//Take over the ring of a thread which has exited
+	//Pending records of the previous owner are simply written before the new ones
+	for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+		bool closed = true;
+		if (ring->closed.compare_exchange_strong(closed, false, std::memory_order_acq_rel)) {
+			handle.ring = ring;
+			return *ring;
+		}
+	}
+	//Otherwise add a new one to the front of the list
+	Ring* ring = new Ring(capacity);
+	ring->next = rings.load(std::memory_order_relaxed);
+	while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed));
+	handle.ring = ring;
+	return *ring;
+}
+
+
+inline void LOG::Log::run()
+{
+	while (running.load(std::memory_order_acquire)) {
+		if (drain())
+			continue;
+		//Nothing to write, wait a bit instead of making the writers signal every message
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		wake.wait_for(lock, std::chrono::milliseconds(1), [this]() { return !running.load(std::memory_order_acquire); });
+	}
+	drain();
+}
+
+
+inline size_t LOG::Log::drain()
+{
+	std::vector<std::pair<Ring*, size_t>> consumed;
+	std::vector<std::ostream*> streams;
+	std::time_t last_time = 0;
+	std::tm tm = local_time(last_time);
+	size_t count = 0;
+	for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+		const size_t head = ring->head.load(std::memory_order_relaxed);
+		const size_t tail = ring->tail.load(std::memory_order_acquire);
+		for (size_t i = head; i < tail; ++i) {
+			const Record& record = ring->records[i & ring->mask];
+			if (record.time != last_time) {
+				last_time = record.time;
+				tm = local_time(last_time);
+			}
+			format(*record.os, tm, record.message);
+			if (std::find(streams.begin(), streams.end(), record.os) == streams.end())
+				streams.push_back(record.os);
+		}
+		if (tail != head)
+			consumed.emplace_back(ring, tail);
+		count += tail - head;
+	}
+	//Flush once per batch and only then release the records, such that flush() knows they were written
+	for (std::ostream* os : streams)
+		os->flush();
+	for (const auto& ring : consumed)
+		ring.first->head.store(ring.second, std::memory_order_release);
+	return count;
+}
+
+
+inline std::tm LOG::Log::local_time(std::time_t t)
+{
+	std::tm tm;
+#if defined(_WIN32)
+	localtime_s(&tm, &t);
+#else
+	localtime_r(&t, &tm);
+#endif
+	return tm;
+}
+
+
+inline void LOG::Log::format(std::ostream& os, const std::tm& tm, const std::string& message)
+{
+	os << "[" << std::put_time(&tm, "%T") << "] -> " << message << '\n';
 }
 
 
@@ -160,7 +459,63 @@ inline void LOG::activate(char identifier)
 }
 
 
-void LOG::deactivate(char identifier)
+inline void LOG::deactivate(char identifier)
 {
 	Log::instance().deactivate(identifier);
-}
\ No newline at end of file
+}
+
+
+inline bool LOG::is_active(char identifier)
+{
+	return Log::instance().is_active(identifier);
+}
+
+
+inline constexpr bool LOG::compiled(char identifier)
+{
+	for (const char* c = LOG_DISABLED_IDENTIFIERS; *c; ++c) {
+		if (*c == identifier)
+			return false;
+	}
+	return true;
+}
+
+
+template<char Identifier, typename F>
+void LOG::write(std::ostream& os, F&& make_message)
+{
+	if constexpr (compiled(Identifier)) {
+		Log& log = Log::instance();
+		if (log.is_active(Identifier))
+			log.log(make_message(), os);
+	}
+}
+
+
+inline void LOG::start_async(Overflow overflow, size_t capacity)
+{
+	Log::instance().start_async(overflow, capacity);
+}
+
+
+inline void LOG::stop_async()
+{
+	Log::instance().stop_async();
+}
+
+
+inline void LOG::flush()
+{
+	Log::instance().flush();
+}
+
+
+inline size_t LOG::dropped()
+{
+	return Log::instance().dropped();
+}
+
+
+
+//Write the message only if the identifier is active, without evaluating the message expression otherwise
+#define LOG_WRITE(identifier, os, message) LOG::write<(identifier)>((os), [&]() -> std::string { return (message); })
@@ -1,44 +1,78 @@
 #ifndef SKIPLIST_H
 #define SKIPLIST_H
 
-#include <cstdlib>
+#include <cstdint>
 #include <utility>
 #include <iterator>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+namespace skiplist_detail
+{
+	//POST: Returns uniformly distributed random bits
+	//      Every thread has its own xorshift generator, so there is no shared state
+	inline uint64_t random_bits()
+	{
+		thread_local uint64_t state = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^ 0x9E3779B97F4A7C15ull) | 1;
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
 
 
-#define MAX_LEVEL 8
-
+	constexpr int log2(int n)
+	{
+		return n <= 1 ? 0 : 1 + log2(n / 2);
+	}
 
 
-//POST: Returns a random number from 1 up to MAX_LEVEL
-//      With exponentially falling probabilities
-char random_lvl()
-{
-	char level = 1;
-	while ((std::rand() % 2) && (level < MAX_LEVEL))
-		++level;
-	return level;
+	//POST: Returns a random number from 1 up to MaxLevel
+	//      Level l is reached with probability Branching^-(l-1), which only takes a single random number:
+	//      Every group of log2(Branching) trailing zero bits is one more level
+	template<int MaxLevel, int Branching>
+	int random_level()
+	{
+		static_assert(MaxLevel >= 1 && MaxLevel <= 64, "MaxLevel has to be in [1, 64]");
+		static_assert(Branching >= 2 && (Branching & (Branching - 1)) == 0, "Branching has to be a power of 2");
+		constexpr int BITS_PER_LEVEL = log2(Branching);
+		const uint64_t bits = random_bits() | (uint64_t(1) << 63);
+#if defined(_MSC_VER)
+		unsigned long zeros;
+		_BitScanForward64(&zeros, bits);
+#else
+		const int zeros = __builtin_ctzll(bits);
+#endif
+		const int level = 1 + int(zeros) / BITS_PER_LEVEL;
+		return level < MaxLevel ? level : MaxLevel;
+	}
 }
 
 
 
-template<typename T>
+//MaxLevel is the maximum height of a node, a node reaches the next level with probability 1 / Branching.
+//The default parameters are suited for lists of up to about 2^32 elements
+template<typename T, int MaxLevel = 32, int Branching = 2>
 class SkipList
 {
+	//The array of next pointers is stored directly behind the node in the same block
 	struct Node
 	{
-		Node();
-		Node(const T& d);
 		Node(const T& d, char lvl);
-		Node(const Node& other);
-		Node(Node&& other);
-		~Node();
+		Node(const Node& other) = delete;
 
-		Node& operator=(const Node& other);
-		Node& operator=(Node&& other);
-
-		void swap(Node& other);
+		Node& operator=(const Node& other) = delete;
 
 		char level;
 		T data;
@@ -46,6 +80,35 @@ class SkipList
 	};
 
 
+	//Allocates the blocks of the nodes of one list
+	//The blocks are cut from large chunks and freed blocks are reused through one free list per level,
+	//as all blocks of the same level have the same size. Destroying the pool frees all chunks at once.
+	class NodePool
+	{
+	public:
+		NodePool() = default;
+		NodePool(const NodePool& other) = delete;
+		~NodePool();
+
+		NodePool& operator=(const NodePool& other) = delete;
+
+		Node* create(const T& data, char level);
+		void destroy(Node* node);
+
+		void swap(NodePool& other);
+
+	private:
+		static constexpr size_t CHUNK_SIZE = 65536;
+
+		std::vector<char*> chunks;
+		char* chunk_position = nullptr;	//The unused part of the newest chunk
+		size_t chunk_remaining = 0;
+		void* free_blocks[MaxLevel] = {};	//The free blocks of every level, linked through their first bytes
+
+		static size_t block_size(char level);
+	};
+
+
 public:
 	class iterator : public std::iterator<std::input_iterator_tag, T>
 	{
@@ -63,26 +126,68 @@ public:
 	};
 
 
+	//The elements in [begin(), end()), usable in range based for loops
+	class Range
+	{
+	public:
+		Range(iterator first, iterator last) : first(first), last(last) {}
+		iterator begin() const { return first; }
+		iterator end() const { return last; }
+
+	private:
+		iterator first;
+		iterator last;
+	};
+
+
 	SkipList();
-	SkipList(const SkipList<T>& other);
-	SkipList(SkipList<T>&& other);
+	SkipList(const SkipList& other);
+	SkipList(SkipList&& other);
 	~SkipList();
 
-	SkipList<T>& operator=(const SkipList<T>& other);
-	SkipList<T>& operator=(SkipList<T>&& other);
+	SkipList& operator=(const SkipList& other);
+	SkipList& operator=(SkipList&& other);
+
+	//Builds a list from the sorted elements in [begin, end)
+	//All levels are linked in a single pass, without searching for the position of any element
+	template<typename Iterator>
+	static SkipList from_sorted(Iterator begin, Iterator end);
 
 	T* find(const T& value) const;
 	void insert(const T& value);
 	void erase(const T& value);
+	//Insert or erase all elements in [begin, end). If the elements are sorted, the search for the next element
+	//starts from the position of the previous one instead of the root and only takes O(log(distance)) steps
+	template<typename Iterator>
+	void insert_sorted(Iterator begin, Iterator end);
+	template<typename Iterator>
+	void erase_sorted(Iterator begin, Iterator end);
 
 	iterator begin() const;
 	iterator end() const;
+	iterator lower_bound(const T& value) const;	//The first element not less than value
+	iterator upper_bound(const T& value) const;	//The first element greater than value
+	Range range(const T& low, const T& high) const;	//All elements in [low, high)
 
 
 private:
+	NodePool pool;
 	Node* root;
 
-	void swap(SkipList<T>& other);
+	//Returns the last node whose data is less than value (or not greater than value if inclusive)
+	//The root is returned if there is no such node
+	Node* predecessor(const T& value, bool inclusive) const;
+	//A finger contains a node on every level, all of which are not greater than the values searched next
+	//Moves the finger to the last node less than value on every level
+	void move_finger(Node** finger, const T& value) const;
+	//Inserts value directly behind the finger, which afterwards points to the new node
+	void link(Node** finger, const T& value);
+	//Erases the nodes containing value directly behind the finger
+	void unlink_equal(Node** finger, const T& value);
+	//Appends the sorted elements in [begin, end) to an empty list
+	template<typename Iterator>
+	void link_sorted(Iterator begin, Iterator end);
+	void swap(SkipList& other);
 };
 
 
@@ -92,276 +197,870 @@ private:
 --------------- Node Implementation ---------------
 */
 
-template<typename T>
-SkipList<T>::Node::Node()
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::Node::Node(const T& d, char lvl) : level(lvl), data(d)
 {
-	level = random_lvl();
-	next = new Node*[level];
+	next = reinterpret_cast<Node**>(this + 1);
 	//Fill next with nullptrs
-	for (char lvl = 0; lvl < level; ++lvl)
-		next[lvl] = nullptr;
+	for (char l = 0; l < level; ++l)
+		next[l] = nullptr;
 }
 
 
-template<typename T>
-SkipList<T>::Node::Node(const T& d) : data(d)
+
+
+/*
+--------------- NodePool Implementation ---------------
+*/
+
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::NodePool::~NodePool()
 {
-	level = random_lvl();
-	next = new Node*[level];
-	//Fill next with nullptrs
-	for (char lvl = 0; lvl < level; ++lvl)
-		next[lvl] = nullptr;
+	for (char* chunk : chunks)
+		::operator delete(chunk);
 }
 
 
-template<typename T>
-SkipList<T>::Node::Node(const T& d, char lvl) : data(d), level(lvl)
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::Node* SkipList<T, MaxLevel, Branching>::NodePool::create(const T& data, char level)
 {
-	next = new Node*[level];
-	//Fill next with nullptrs
-	for (char lvl = 0; lvl < level; ++lvl)
-		next[lvl] = nullptr;
+	void* block = free_blocks[level - 1];
+	if (block)
+		free_blocks[level - 1] = *static_cast<void**>(block);
+	else {
+		//Cut the block from the current chunk
+		const size_t size = block_size(level);
+		if (chunk_remaining < size) {
+			const size_t chunk_size = std::max(CHUNK_SIZE, size);
+			chunks.push_back(static_cast<char*>(::operator new(chunk_size)));
+			chunk_position = chunks.back();
+			chunk_remaining = chunk_size;
+		}
+		block = chunk_position;
+		chunk_position += size;
+		chunk_remaining -= size;
+	}
+	return new (block) Node(data, level);
 }
 
 
-template<typename T>
-SkipList<T>::Node::Node(const Node& other)
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::NodePool::destroy(Node* node)
 {
-	//Copy the data of the node
-	data = other.data;
-	level = other.level;
-	//Copying the next pointers of the node
-	next = new Node*[level];
-	for (size_t i = 0; i < level; ++i)
-		next[i] = other.next[i];
+	const char level = node->level;
+	node->~Node();
+	*reinterpret_cast<void**>(node) = free_blocks[level - 1];
+	free_blocks[level - 1] = node;
 }
 
 
-template<typename T>
-SkipList<T>::Node::Node(Node&& other)
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::NodePool::swap(NodePool& other)
+{
+	std::swap(chunks, other.chunks);
+	std::swap(chunk_position, other.chunk_position);
+	std::swap(chunk_remaining, other.chunk_remaining);
+	std::swap(free_blocks, other.free_blocks);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+size_t SkipList<T, MaxLevel, Branching>::NodePool::block_size(char level)
+{
+	//Every block starts with a node, so the size is rounded up to its alignment
+	const size_t size = sizeof(Node) + level * sizeof(Node*);
+	return (size + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+}
+
+
+
+
+/*
+--------------- SkipList Implementation ---------------
+*/
+
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::SkipList()
+{
+	T root_elem;
+	root = pool.create(root_elem, MaxLevel);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::SkipList(const SkipList<T, MaxLevel, Branching>& other) : SkipList()
+{
+	link_sorted(other.begin(), other.end());
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::SkipList(SkipList<T, MaxLevel, Branching>&& other) : SkipList()
 {
+	//other is left as an empty list
 	swap(other);
 }
 
 
-template<typename T>
-SkipList<T>::Node::~Node()
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>::~SkipList()
 {
-	if (next) delete next;      //next could be nullptr, if a move constructor was called and no next array has been initialized
+	//The memory is freed by the pool, only the data of the nodes has to be destroyed
+	if (!std::is_trivially_destructible<T>::value) {
+		Node* current_node = root;
+		while (current_node) {
+			Node* next = current_node->next[0];
+			current_node->~Node();
+			current_node = next;
+		}
+	}
 }
 
 
-template<typename T>
-typename SkipList<T>::Node& SkipList<T>::Node::operator=(const typename SkipList<T>::Node& other)
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>& SkipList<T, MaxLevel, Branching>::operator=(const SkipList<T, MaxLevel, Branching>& other)
 {
-	Node tmp(other);    //Copy
+	SkipList<T, MaxLevel, Branching> tmp(other);
 	swap(tmp);
 	return *this;
 }
 
 
-template<typename T>
-typename SkipList<T>::Node& SkipList<T>::Node::operator=(typename SkipList<T>::Node&& other)
+template<typename T, int MaxLevel, int Branching>
+SkipList<T, MaxLevel, Branching>& SkipList<T, MaxLevel, Branching>::operator=(SkipList<T, MaxLevel, Branching>&& other)
 {
 	swap(other);
 	return *this;
 }
 
 
-template<typename T>
-void SkipList<T>::Node::swap(Node& other)
+template<typename T, int MaxLevel, int Branching>
+template<typename Iterator>
+SkipList<T, MaxLevel, Branching> SkipList<T, MaxLevel, Branching>::from_sorted(Iterator begin, Iterator end)
 {
-	std::swap(data, other.data);
-	std::swap(level, other.level);
-	std::swap(next, other.next);
+	SkipList<T, MaxLevel, Branching> list;
+	list.link_sorted(begin, end);
+	return list;
 }
 
 
+template<typename T, int MaxLevel, int Branching>
+T* SkipList<T, MaxLevel, Branching>::find(const T& value) const
+{
+	Node* current_node = predecessor(value, false)->next[0];
+	//Return nullptr if the first node not less than value is greater than value
+	if (!current_node || value < current_node->data)
+		return nullptr;
+	//The node was found
+	return &(current_node->data);
+}
 
 
-/*
---------------- SkipList Implementation ---------------
-*/
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::insert(const T& value)
+{
+	//Find the nodes preceeding the node to insert on each level
+	Node* finger[MaxLevel];
+	std::fill_n(finger, MaxLevel, root);
+	move_finger(finger, value);
+	link(finger, value);
+}
 
-template<typename T>
-SkipList<T>::SkipList()
+
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::erase(const T& value)
 {
-	T root_elem;
-	root = new Node(root_elem, MAX_LEVEL);
+	//Find the nodes preceeding the nodes to delete on each level
+	Node* finger[MaxLevel];
+	std::fill_n(finger, MaxLevel, root);
+	move_finger(finger, value);
+	unlink_equal(finger, value);
 }
 
 
-template<typename T>
-SkipList<T>::SkipList(const SkipList<T>& other)
+template<typename T, int MaxLevel, int Branching>
+template<typename Iterator>
+void SkipList<T, MaxLevel, Branching>::insert_sorted(Iterator begin, Iterator end)
 {
-	//Initialize a new root element
-	T root_elem;
-	root = new Node(root_elem, MAX_LEVEL);
-	//Copy nodes on the first level
+	Node* finger[MaxLevel];
+	std::fill_n(finger, MaxLevel, root);
+	for (Iterator it = begin; it != end; ++it) {
+		//The finger is only valid for values not less than the previous one
+		if (finger[0] != root && *it < finger[0]->data)
+			std::fill_n(finger, MaxLevel, root);
+		move_finger(finger, *it);
+		link(finger, *it);
+	}
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+template<typename Iterator>
+void SkipList<T, MaxLevel, Branching>::erase_sorted(Iterator begin, Iterator end)
+{
+	Node* finger[MaxLevel];
+	std::fill_n(finger, MaxLevel, root);
+	for (Iterator it = begin; it != end; ++it) {
+		//The finger is only valid for values greater than the nodes it points to
+		if (finger[0] != root && !(finger[0]->data < *it))
+			std::fill_n(finger, MaxLevel, root);
+		move_finger(finger, *it);
+		unlink_equal(finger, *it);
+	}
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::iterator SkipList<T, MaxLevel, Branching>::begin() const
+{
+	return iterator(root->next[0]);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::iterator SkipList<T, MaxLevel, Branching>::end() const
+{
+	return iterator(nullptr);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::iterator SkipList<T, MaxLevel, Branching>::lower_bound(const T& value) const
+{
+	return iterator(predecessor(value, false)->next[0]);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::iterator SkipList<T, MaxLevel, Branching>::upper_bound(const T& value) const
+{
+	return iterator(predecessor(value, true)->next[0]);
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::Range SkipList<T, MaxLevel, Branching>::range(const T& low, const T& high) const
+{
+	if (!(low < high))
+		return Range(end(), end());
+	return Range(lower_bound(low), lower_bound(high));
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+typename SkipList<T, MaxLevel, Branching>::Node* SkipList<T, MaxLevel, Branching>::predecessor(const T& value, bool inclusive) const
+{
+	//Walk right as far as possible on every level before descending
 	Node* current_node = root;
-	for (const auto& n : other) {
-		current_node->next[0] = new Node(n);
-		current_node = current_node->next[0];
+	for (int lvl = MaxLevel - 1; lvl >= 0; --lvl) {
+		Node* next = current_node->next[lvl];
+		while (next && (inclusive ? !(value < next->data) : next->data < value)) {
+			current_node = next;
+			next = current_node->next[lvl];
+		}
+	}
+	return current_node;
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::move_finger(Node** finger, const T& value) const
+{
+	//If the finger is outdated on a level, i.e. there are nodes less than value behind it, these nodes
+	//exist on all lower levels as well. So the finger only has to be moved on the levels below the first one
+	//on which it is still valid, which are about log(distance) levels
+	int valid = 0;
+	while (valid < MaxLevel && finger[valid]->next[valid] && finger[valid]->next[valid]->data < value)
+		++valid;
+	for (int lvl = valid - 1; lvl >= 0; --lvl) {
+		//Continue from the node found on the level above, if it is further to the right
+		if (lvl + 1 < MaxLevel && finger[lvl + 1] != root && (finger[lvl] == root || finger[lvl]->data < finger[lvl + 1]->data))
+			finger[lvl] = finger[lvl + 1];
+		while (finger[lvl]->next[lvl] && finger[lvl]->next[lvl]->data < value)
+			finger[lvl] = finger[lvl]->next[lvl];
+	}
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::link(Node** finger, const T& value)
+{
+	Node* to_insert = pool.create(value, skiplist_detail::random_level<MaxLevel, Branching>());
+	for (int lvl = 0; lvl < to_insert->level; ++lvl) {
+		//Rout the node to insert next pointer to the corresponding node
+		to_insert->next[lvl] = finger[lvl]->next[lvl];
+		//Rerout the next pointer of the preceeding node to point at this node
+		finger[lvl]->next[lvl] = to_insert;
+		//The following values are inserted behind this node
+		finger[lvl] = to_insert;
+	}
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::unlink_equal(Node** finger, const T& value)
+{
+	//Iteratively delete the following nodes with value
+	Node* current_node = finger[0]->next[0];
+	while (current_node && current_node->data == value) {
+		//Delete the node
+		for (int lvl = 0; lvl < current_node->level; ++lvl)
+			finger[lvl]->next[lvl] = current_node->next[lvl];
+		Node* tmp = current_node->next[0];
+		pool.destroy(current_node);
+		current_node = tmp;
 	}
-	//Link the higher levels
-	Node* to_link[MAX_LEVEL];
-	for (char lvl = 0; lvl < MAX_LEVEL; ++lvl)
+}
+
+
+template<typename T, int MaxLevel, int Branching>
+template<typename Iterator>
+void SkipList<T, MaxLevel, Branching>::link_sorted(Iterator begin, Iterator end)
+{
+	//The last node on every level, after which the next node of that level gets linked
+	Node* to_link[MaxLevel];
+	for (int lvl = 0; lvl < MaxLevel; ++lvl)
 		to_link[lvl] = root;
-	Node* n = root->next[0];
-	while (n) {
-		for (char lvl = 1; lvl < n->level; ++lvl) {
-			to_link[lvl]->next[lvl] = n;
-			to_link[lvl] = n;
+	for (Iterator it = begin; it != end; ++it) {
+		assert((to_link[0] == root || !(*it < to_link[0]->data)) && "The elements have to be sorted");
+		Node* node = pool.create(*it, skiplist_detail::random_level<MaxLevel, Branching>());
+		for (int lvl = 0; lvl < node->level; ++lvl) {
+			to_link[lvl]->next[lvl] = node;
+			to_link[lvl] = node;
 		}
-		n = n->next[0];
 	}
 }
 
 
+template<typename T, int MaxLevel, int Branching>
+void SkipList<T, MaxLevel, Branching>::swap(SkipList<T, MaxLevel, Branching>& other)
+{
+	pool.swap(other.pool);
+	std::swap(root, other.root);
+}
+
+
+
+
+/*
+--------------- Concurrent SkipList ---------------
+*/
+
+namespace skiplist_detail
+{
+	//Epoch based memory reclamation
+	//Threads announce the global epoch while they access shared nodes. A node which has been unlinked
+	//is retired together with the current epoch and only freed after the global epoch has advanced twice,
+	//as by then no thread can still hold a pointer to it. The epoch advances once every active thread has
+	//announced the current one.
+	class EpochDomain
+	{
+	public:
+		static EpochDomain& instance();
+		~EpochDomain();
+
+		void enter();
+		void leave();
+		//The deleter is called with pointer once no thread can access it anymore
+		void retire(void* pointer, void (*deleter)(void*));
+
+	private:
+		static constexpr uint64_t INACTIVE = ~uint64_t(0);
+		static constexpr size_t RETIRE_THRESHOLD = 64;	//Try to free the retired nodes of a thread every this many retirements
+
+		struct Retired
+		{
+			uint64_t epoch;
+			void* pointer;
+			void (*deleter)(void*);
+		};
+
+		//State of a thread, records are reused after a thread exits
+		struct Record
+		{
+			std::atomic<uint64_t> epoch{INACTIVE};	//The announced epoch, INACTIVE outside of critical sections
+			std::atomic<bool> in_use{false};
+			Record* next = nullptr;
+			unsigned nesting = 0;
+			std::vector<Retired> retired;
+		};
+
+		//Releases the record of a thread when it exits
+		struct Handle
+		{
+			Record* record = nullptr;
+			~Handle() { if (record) record->in_use.store(false, std::memory_order_release); }
+		};
+
+		std::atomic<uint64_t> global_epoch{0};
+		std::atomic<Record*> records{nullptr};	//Records are only ever added to this list
+
+		EpochDomain() = default;
+		Record& local();
+		bool try_advance();
+		void collect(Record& record);
+	};
+
+
+	//Keeps the calling thread inside a critical section as long as it exists
+	//Guards can be nested, but must be destroyed by the thread which created them
+	class EpochGuard
+	{
+	public:
+		EpochGuard() { EpochDomain::instance().enter(); }
+		EpochGuard(const EpochGuard&) { EpochDomain::instance().enter(); }
+		~EpochGuard() { EpochDomain::instance().leave(); }
+		EpochGuard& operator=(const EpochGuard&) { return *this; }
+	};
+
+
+	inline EpochDomain& EpochDomain::instance()
+	{
+		static EpochDomain domain;
+		return domain;
+	}
+
+
+	inline EpochDomain::~EpochDomain()
+	{
+		Record* record = records.load();
+		while (record) {
+			for (const Retired& r : record->retired)
+				r.deleter(r.pointer);
+			Record* next = record->next;
+			delete record;
+			record = next;
+		}
+	}
+
+
+	inline void EpochDomain::enter()
+	{
+		Record& record = local();
+		if (record.nesting++ == 0) {
+			record.epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+			//The announcement has to be visible before any node is read
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+
+	inline void EpochDomain::leave()
+	{
+		Record& record = local();
+		if (--record.nesting == 0)
+			record.epoch.store(INACTIVE, std::memory_order_release);
+	}
+
+
+	inline void EpochDomain::retire(void* pointer, void (*deleter)(void*))
+	{
+		Record& record = local();
+		//Reading the epoch with a RMW orders it after the unlinking of the node for every thread advancing the epoch
+		record.retired.push_back({global_epoch.fetch_add(0, std::memory_order_acq_rel), pointer, deleter});
+		if (record.retired.size() >= RETIRE_THRESHOLD) {
+			try_advance();
+			collect(record);
+		}
+	}
+
+
+	inline EpochDomain::Record& EpochDomain::local()
+	{
+		thread_local Handle handle;
+		if (!handle.record) {
+			//Reuse the record of a thread which has exited
+			for (Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+				bool expected = false;
+				if (!record->in_use.load(std::memory_order_relaxed) && record->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+					handle.record = record;
+					return *record;
+				}
+			}
+			Record* record = new Record;
+			record->in_use.store(true, std::memory_order_relaxed);
+			record->next = records.load(std::memory_order_relaxed);
+			while (!records.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+			handle.record = record;
+		}
+		return *handle.record;
+	}
+
+
+	inline bool EpochDomain::try_advance()
+	{
+		uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+		for (Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+			const uint64_t announced = record->epoch.load(std::memory_order_seq_cst);
+			if (announced != INACTIVE && announced != epoch)
+				return false;
+		}
+		return global_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+	}
+
+
+	inline void EpochDomain::collect(Record& record)
+	{
+		const uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+		size_t kept = 0;
+		for (const Retired& r : record.retired) {
+			if (r.epoch + 2 <= epoch)
+				r.deleter(r.pointer);
+			else
+				record.retired[kept++] = r;
+		}
+		record.retired.resize(kept);
+	}
+}
+
+
+
+//Lock-free SkipList which can be accessed by any number of threads at the same time
+//Unlike SkipList, every value is contained at most once.
+//Nodes are inserted with CAS on every level (Fraser, Herlihy-Shavit). Erasing a node first marks its
+//next pointers (logical deletion), after which they are unlinked by the next search passing by.
+//Neither waits for the other: a node erased while it is still being inserted is unlinked and freed by the inserting thread.
+//contains() and iteration never write to shared memory. Erased nodes are freed with epoch based reclamation,
+//iterators keep the thread in a critical section, so the node they point to stays valid.
 template<typename T>
-SkipList<T>::SkipList(SkipList<T>&& other)
+class ConcurrentSkipList
 {
-	swap(other);
+	static constexpr int MAX_HEIGHT = 32;
+
+	struct alignas(std::atomic<uintptr_t>) Node
+	{
+		enum State { LINKING, LINKED, ERASED_WHILE_LINKING };
+
+		Node(const T& d, int h) : data(d), height(h), state(LINKING) {}
+
+		T data;
+		int height;
+		std::atomic<int> state;		//Decides whether insert or erase frees a node which is erased while it is linked
+
+		//The low bit of a next pointer marks the node as erased on that level
+		//The pointers are stored directly behind the node in the same allocation
+		std::atomic<uintptr_t>& next(int lvl) { return reinterpret_cast<std::atomic<uintptr_t>*>(this + 1)[lvl]; }
+
+		static Node* create(const T& data, int height);
+		static void destroy(void* node);
+		static Node* pointer(uintptr_t link) { return reinterpret_cast<Node*>(link & ~uintptr_t(1)); }
+		static bool marked(uintptr_t link) { return link & 1; }
+	};
+
+
+public:
+	//Iterates through the values in ascending order
+	//Values which are inserted or erased during the iteration may or may not be visited.
+	//An iterator must only be used by the thread which created it
+	class iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const T*;
+		using reference = const T&;
+
+		iterator() : current_node(nullptr) {}
+		iterator& operator++();
+		iterator operator++(int) { iterator tmp = *this; ++(*this); return tmp; }
+		bool operator==(const iterator& other) const { return current_node == other.current_node; }
+		bool operator!=(const iterator& other) const { return !(*this == other); }
+		const T& operator*() const { return current_node->data; }
+		const T* operator->() const { return &current_node->data; }
+
+	private:
+		friend class ConcurrentSkipList<T>;
+
+		explicit iterator(Node* node) : current_node(node) {}
+
+		skiplist_detail::EpochGuard guard;
+		Node* current_node;
+	};
+
+
+	ConcurrentSkipList();
+	ConcurrentSkipList(const ConcurrentSkipList<T>& other);
+	~ConcurrentSkipList();	//Must not be called while other threads access the list
+
+	ConcurrentSkipList<T>& operator=(const ConcurrentSkipList<T>& other) = delete;
+
+	bool contains(const T& value) const;
+	iterator find(const T& value) const;	//Returns end() if value is not contained
+	bool insert(const T& value);			//Returns false if value was already contained
+	bool erase(const T& value);				//Returns false if value was not contained
+
+	iterator begin() const;
+	iterator end() const;
+
+
+private:
+	Node* root;
+
+	//Finds the last node before value (preds) and the first node not before value (succs) on every level
+	//and unlinks the erased nodes passed on the way. Returns true if succs[0] contains value
+	bool find(const T& value, Node** preds, Node** succs) const;
+	//Returns the first node at or after node which has not been erased
+	static Node* skip_erased(Node* node);
+};
+
+
+
+
+/*
+--------------- ConcurrentSkipList Node Implementation ---------------
+*/
+
+template<typename T>
+typename ConcurrentSkipList<T>::Node* ConcurrentSkipList<T>::Node::create(const T& data, int height)
+{
+	void* memory = ::operator new(sizeof(Node) + height * sizeof(std::atomic<uintptr_t>));
+	Node* node = new (memory) Node(data, height);
+	for (int lvl = 0; lvl < height; ++lvl)
+		new (&node->next(lvl)) std::atomic<uintptr_t>(0);
+	return node;
 }
 
 
 template<typename T>
-SkipList<T>::~SkipList()
+void ConcurrentSkipList<T>::Node::destroy(void* memory)
 {
-	//Iterate through the nodes on the first level and delete them
-	Node* current_node = root;
-	while (current_node) {
-		Node* next = current_node->next[0];
-		delete current_node;
-		current_node = next;
-	}
+	static_cast<Node*>(memory)->~Node();
+	::operator delete(memory);
 }
 
 
+
+
+/*
+--------------- ConcurrentSkipList Implementation ---------------
+*/
+
 template<typename T>
-SkipList<T>& SkipList<T>::operator=(const SkipList<T>& other)
+typename ConcurrentSkipList<T>::iterator& ConcurrentSkipList<T>::iterator::operator++()
 {
-	SkipList<T> tmp(other);
-	swap(tmp);
+	current_node = skip_erased(Node::pointer(current_node->next(0).load(std::memory_order_acquire)));
 	return *this;
 }
 
 
 template<typename T>
-SkipList<T>& SkipList<T>::operator=(SkipList<T>&& other)
+ConcurrentSkipList<T>::ConcurrentSkipList()
 {
-	swap(other);
-	return *this;
+	root = Node::create(T(), MAX_HEIGHT);
+	root->state.store(Node::LINKED, std::memory_order_relaxed);
 }
 
 
 template<typename T>
-T* SkipList<T>::find(const T& value) const
+ConcurrentSkipList<T>::ConcurrentSkipList(const ConcurrentSkipList<T>& other) : ConcurrentSkipList()
 {
-	//Return nullptr if no node is in the list
-	if (!root->next[0])
-		return nullptr;
-	Node* current_node = root->next[0];
-	//Else continue the search
-	while (current_node->data < value) {
-		char lvl_step = current_node->level;
-		while (lvl_step >= 0 && current_node->next[lvl_step] && current_node->next[lvl_step]->data > value)
-			--lvl_step;
-		if (lvl_step < 0)   //The value was not found
-			return nullptr;
-		//The value could still be found
-		current_node = current_node->next[lvl_step];
+	//The values are already sorted, so every level can be linked in a single pass
+	Node* to_link[MAX_HEIGHT];
+	for (int lvl = 0; lvl < MAX_HEIGHT; ++lvl)
+		to_link[lvl] = root;
+	for (const T& value : other) {
+		Node* node = Node::create(value, skiplist_detail::random_level<MAX_HEIGHT, 2>());
+		node->state.store(Node::LINKED, std::memory_order_relaxed);
+		for (int lvl = 0; lvl < node->height; ++lvl) {
+			to_link[lvl]->next(lvl).store(reinterpret_cast<uintptr_t>(node), std::memory_order_relaxed);
+			to_link[lvl] = node;
+		}
 	}
-	//The node was found
-	return &(current_node->data);
+	std::atomic_thread_fence(std::memory_order_release);
 }
 
 
 template<typename T>
-void SkipList<T>::insert(const T& value)
+ConcurrentSkipList<T>::~ConcurrentSkipList()
 {
-	//Find the nodes preceeding the node to insert on each level
-	Node* nodes_to_relink[MAX_LEVEL];   //An array of the nodes on all levels after which the new value gets inserted
-	//Calculate the highest level specially, as it has no possibility of starting from a previously discovered node
-	nodes_to_relink[MAX_LEVEL - 1] = root;
-	while (nodes_to_relink[MAX_LEVEL - 1] && nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1] && nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1]->data < value)
-		nodes_to_relink[MAX_LEVEL - 1] = nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1];
-	//Calculate all the other levels
-	for (char lvl = MAX_LEVEL - 2; lvl >= 0; --lvl) {
-		if (nodes_to_relink[lvl + 1])
-			nodes_to_relink[lvl] = nodes_to_relink[lvl + 1];
-		else
-			nodes_to_relink[lvl] = root->next[lvl];
-		while (nodes_to_relink[lvl] && nodes_to_relink[lvl]->next[lvl] && nodes_to_relink[lvl]->next[lvl]->data < value)
-			nodes_to_relink[lvl] = nodes_to_relink[lvl]->next[lvl];
+	Node* current_node = root;
+	while (current_node) {
+		Node* next = Node::pointer(current_node->next(0).load(std::memory_order_relaxed));
+		Node::destroy(current_node);
+		current_node = next;
 	}
+}
+
 
-	//Inserting a new node
-	Node* to_insert = new Node(value);
-	for (char lvl = to_insert->level - 1; lvl >= 0; --lvl) {
-		if (nodes_to_relink[lvl]) {
-			//Rout the node to insert next pointer to the corresponding node
-			to_insert->next[lvl] = nodes_to_relink[lvl]->next[lvl];
-			//Rerout the next pointer of the preceeding node to point at this node
-			nodes_to_relink[lvl]->next[lvl] = to_insert;
+template<typename T>
+bool ConcurrentSkipList<T>::contains(const T& value) const
+{
+	return find(value) != end();
+}
+
+
+template<typename T>
+typename ConcurrentSkipList<T>::iterator ConcurrentSkipList<T>::find(const T& value) const
+{
+	iterator it;	//Enters the critical section before the first node is read
+	//Same search as in find(value, preds, succs), but erased nodes are skipped instead of unlinked
+	Node* pred = root;
+	Node* current_node = nullptr;
+	for (int lvl = MAX_HEIGHT - 1; lvl >= 0; --lvl) {
+		current_node = Node::pointer(pred->next(lvl).load(std::memory_order_acquire));
+		while (current_node) {
+			const uintptr_t succ = current_node->next(lvl).load(std::memory_order_acquire);
+			if (!Node::marked(succ) && !(current_node->data < value))
+				break;
+			if (!Node::marked(succ))
+				pred = current_node;
+			current_node = Node::pointer(succ);
 		}
-		else
-			//Rerout the pointer of the root to point at this node
-			root->next[lvl] = to_insert;
 	}
+	if (current_node && !(value < current_node->data) && !Node::marked(current_node->next(0).load(std::memory_order_acquire)))
+		it.current_node = current_node;
+	return it;
 }
 
 
 template<typename T>
-void SkipList<T>::erase(const T& value)
+bool ConcurrentSkipList<T>::insert(const T& value)
 {
-	//Find the nodes preceeding the node to insert on each level
-	Node* nodes_to_relink[MAX_LEVEL];   //An array of the nodes on all levels after which the new value gets inserted
-	//Calculate the highest level specially, as it has no possibility of starting from a previously discovered node
-	nodes_to_relink[MAX_LEVEL - 1] = root;
-	while (nodes_to_relink[MAX_LEVEL - 1] && nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1] && nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1]->data < value)
-		nodes_to_relink[MAX_LEVEL - 1] = nodes_to_relink[MAX_LEVEL - 1]->next[MAX_LEVEL - 1];
-	//Calculate all the other levels
-	for (char lvl = MAX_LEVEL - 2; lvl >= 0; --lvl) {
-		if (nodes_to_relink[lvl + 1])
-			nodes_to_relink[lvl] = nodes_to_relink[lvl + 1];
-		else
-			nodes_to_relink[lvl] = root->next[lvl];
-		while (nodes_to_relink[lvl] && nodes_to_relink[lvl]->next[lvl] && nodes_to_relink[lvl]->next[lvl]->data < value)
-			nodes_to_relink[lvl] = nodes_to_relink[lvl]->next[lvl];
+	skiplist_detail::EpochGuard guard;
+	Node* preds[MAX_HEIGHT];
+	Node* succs[MAX_HEIGHT];
+	Node* node = nullptr;
+	while (true) {
+		if (find(value, preds, succs)) {
+			if (node)
+				Node::destroy(node);	//Has never been visible to other threads
+			return false;
+		}
+		if (!node)
+			node = Node::create(value, skiplist_detail::random_level<MAX_HEIGHT, 2>());
+		for (int lvl = 0; lvl < node->height; ++lvl)
+			node->next(lvl).store(reinterpret_cast<uintptr_t>(succs[lvl]), std::memory_order_relaxed);
+		//Inserting the node on the lowest level makes it part of the list
+		uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+		if (preds[0]->next(0).compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node), std::memory_order_acq_rel))
+			break;
 	}
-
-	//Iteratively delete the following nodes with value
-	Node* current_node = nodes_to_relink[0]->next[0];
-	while (current_node && current_node->data == value) {
-		//Delete the node
-		for (char lvl = 0; lvl < current_node->level; ++lvl)
-			nodes_to_relink[lvl]->next[lvl] = current_node->next[lvl];
-		Node* tmp = current_node->next[0];
-		delete current_node;
-		current_node = tmp;
+	//Link the higher levels, the predecessors have to be searched again if they changed in between.
+	//Erasing the node marks its levels from the top down, so the remaining levels are not linked once a mark shows up
+	for (int lvl = 1; lvl < node->height; ++lvl) {
+		uintptr_t link = node->next(lvl).load(std::memory_order_acquire);
+		while (!Node::marked(link)) {
+			uintptr_t expected = reinterpret_cast<uintptr_t>(succs[lvl]);
+			if (preds[lvl]->next(lvl).compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node), std::memory_order_acq_rel))
+				break;
+			find(value, preds, succs);
+			//Fails if the node has been marked in the meantime
+			if (node->next(lvl).compare_exchange_strong(link, reinterpret_cast<uintptr_t>(succs[lvl]), std::memory_order_acq_rel))
+				link = reinterpret_cast<uintptr_t>(succs[lvl]);
+		}
+		if (Node::marked(link))
+			break;
+	}
+	int state = Node::LINKING;
+	if (!node->state.compare_exchange_strong(state, Node::LINKED, std::memory_order_acq_rel)) {
+		//Erased before all levels were linked, erase has left unlinking and freeing the node to this thread
+		find(value, preds, succs);
+		skiplist_detail::EpochDomain::instance().retire(node, &Node::destroy);
 	}
+	return true;
 }
 
 
 template<typename T>
-typename SkipList<T>::iterator SkipList<T>::begin() const
+bool ConcurrentSkipList<T>::erase(const T& value)
 {
-	return iterator(root->next[0]);
+	skiplist_detail::EpochGuard guard;
+	Node* preds[MAX_HEIGHT];
+	Node* succs[MAX_HEIGHT];
+	if (!find(value, preds, succs))
+		return false;
+	Node* node = succs[0];
+	//Mark the node from the top down, the thread marking the lowest level has erased it
+	for (int lvl = node->height - 1; lvl > 0; --lvl)
+		node->next(lvl).fetch_or(1, std::memory_order_acq_rel);
+	if (Node::marked(node->next(0).fetch_or(1, std::memory_order_acq_rel)))
+		return false;	//Erased by another thread in the meantime
+	int state = Node::LINKING;
+	if (node->state.compare_exchange_strong(state, Node::ERASED_WHILE_LINKING, std::memory_order_acq_rel))
+		return true;	//The inserting thread may still link levels, it unlinks and frees the node when it is done
+	//Searching the value unlinks the node on every level, afterwards it is no longer reachable
+	find(value, preds, succs);
+	skiplist_detail::EpochDomain::instance().retire(node, &Node::destroy);
+	return true;
 }
 
 
 template<typename T>
-typename SkipList<T>::iterator SkipList<T>::end() const
+typename ConcurrentSkipList<T>::iterator ConcurrentSkipList<T>::begin() const
 {
-	return iterator(nullptr);
+	iterator it;
+	it.current_node = skip_erased(Node::pointer(root->next(0).load(std::memory_order_acquire)));
+	return it;
 }
 
 
 template<typename T>
-void SkipList<T>::swap(SkipList<T>& other)
+typename ConcurrentSkipList<T>::iterator ConcurrentSkipList<T>::end() const
 {
-	std::swap(root, other.root);
+	return iterator();
+}
+
+
+template<typename T>
+bool ConcurrentSkipList<T>::find(const T& value, Node** preds, Node** succs) const
+{
+retry:
+	Node* pred = root;
+	for (int lvl = MAX_HEIGHT - 1; lvl >= 0; --lvl) {
+		Node* current_node = Node::pointer(pred->next(lvl).load(std::memory_order_acquire));
+		while (current_node) {
+			uintptr_t succ = current_node->next(lvl).load(std::memory_order_acquire);
+			//Unlink the nodes on this level which have been erased
+			while (Node::marked(succ)) {
+				uintptr_t expected = reinterpret_cast<uintptr_t>(current_node);
+				if (!pred->next(lvl).compare_exchange_strong(expected, succ & ~uintptr_t(1), std::memory_order_acq_rel))
+					goto retry;		//pred has been erased itself or a node has been inserted after it
+				current_node = Node::pointer(succ);
+				if (!current_node)
+					break;
+				succ = current_node->next(lvl).load(std::memory_order_acquire);
+			}
+			if (!current_node || !(current_node->data < value))
+				break;
+			pred = current_node;
+			current_node = Node::pointer(succ);
+		}
+		//An erased node is not passed above if a node with the same value has been linked in front of it on this level
+		//while it was erased, so unlink those too. Otherwise erase would free a node which is still reachable
+		for (Node* node = current_node; node && !(value < node->data);) {
+			const uintptr_t link = node->next(lvl).load(std::memory_order_acquire);
+			Node* next = Node::pointer(link);
+			if (Node::marked(link))
+				goto retry;		//node has been erased itself
+			if (!next || value < next->data)
+				break;
+			const uintptr_t succ = next->next(lvl).load(std::memory_order_acquire);
+			if (!Node::marked(succ)) {
+				node = next;
+				continue;
+			}
+			uintptr_t expected = link;
+			if (!node->next(lvl).compare_exchange_strong(expected, succ & ~uintptr_t(1), std::memory_order_acq_rel))
+				goto retry;
+		}
+		preds[lvl] = pred;
+		succs[lvl] = current_node;
+	}
+	return succs[0] && !(value < succs[0]->data);
+}
+
+
+template<typename T>
+typename ConcurrentSkipList<T>::Node* ConcurrentSkipList<T>::skip_erased(Node* node)
+{
+	while (node) {
+		const uintptr_t next = node->next(0).load(std::memory_order_acquire);
+		if (!Node::marked(next))
+			return node;
+		node = Node::pointer(next);
+	}
+	return nullptr;
 }
 
 
@@ -371,8 +1070,17 @@ void SkipList<T>::swap(SkipList<T>& other)
 --------------- Miscellaneous ---------------
 */
 
+template<typename T, int MaxLevel, int Branching>
+std::ostream& operator<<(std::ostream& os, const SkipList<T, MaxLevel, Branching>& sklist)
+{
+	for (const auto& v : sklist)
+		os << v << " ";
+	return os;
+}
+
+
 template<typename T>
-std::ostream& operator<<(std::ostream& os, const SkipList<T>& sklist)
+std::ostream& operator<<(std::ostream& os, const ConcurrentSkipList<T>& sklist)
 {
 	for (const auto& v : sklist)
 		os << v << " ";